@@ -0,0 +1,204 @@
+#include "module.h"
+#include "except.h"
+#include "capi.h"
+#include "conn.h"
+#include "cookie.h"
+#include "error.h"
+#include "event.h"
+#include "ext.h"
+#include "extkey.h"
+#include "request.h"
+#include "rawbuf.h"
+#include "freelist.h"
+#include "memstat.h"
+
+/*
+ * Entry points of the C API table.  They check their arguments the way
+ * the Python methods do, since callers are plain C, and then go through
+ * the same code as the methods so that cookies, flushing and error
+ * handling behave alike.
+ */
+
+/*
+ * Helpers
+ */
+
+static int
+xpybCAPI_check_conn(PyObject *conn)
+{
+    if (!PyObject_TypeCheck(conn, &xpybConn_type)) {
+	PyErr_SetString(PyExc_TypeError, "Expected an xcb.Connection.");
+	return -1;
+    }
+    return xpybConn_invalid((xpybConn *)conn) ? -1 : 0;
+}
+
+static int
+xpybCAPI_check_cookie(PyObject *cookie)
+{
+    if (!PyObject_TypeCheck(cookie, &xpybCookie_type)) {
+	PyErr_SetString(PyExc_TypeError, "Expected an xcb.Cookie.");
+	return -1;
+    }
+    if (((xpybCookie *)cookie)->conn == NULL) {
+	PyErr_SetString(xpybExcept_base, "Cookie has not been sent.");
+	return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+xpybCAPI_send_request(PyObject *ext, const void *data, Py_ssize_t size,
+		      int opcode, int is_void, int is_checked,
+		      PyTypeObject *cookie_type, PyTypeObject *reply_type)
+{
+    xpybRequest *request;
+    xpybRawbuf *buf;
+    PyObject *cookie, *result = NULL;
+
+    if (!PyObject_TypeCheck(ext, &xpybExt_type) ||
+	!PyType_IsSubtype(cookie_type, &xpybCookie_type)) {
+	PyErr_SetString(PyExc_TypeError, "Expected an xcb.Extension and a cookie type.");
+	return NULL;
+    }
+    if (size < 4) {
+	PyErr_SetString(PyExc_ValueError, "Request buffer too short.");
+	return NULL;
+    }
+
+    /*
+     * libxcb copies the request while sending it, so the caller's bytes
+     * are wrapped rather than copied, and taken back out of the buffer
+     * before returning.  The request and cookie skip the type calls and
+     * come straight off the freelists.
+     */
+    buf = (xpybRawbuf *)xpybRawbuf_create((void *)data, size);
+    if (buf == NULL)
+	return NULL;
+
+    request = (xpybRequest *)xpybFreelist_new(&xpybFreelist_protobj, &xpybRequest_type);
+    if (request == NULL)
+	goto out;
+    Py_INCREF(((xpybProtobj *)request)->buf = (PyObject *)buf);
+    ((xpybProtobj *)request)->size = Py_END_OF_BUFFER;
+    request->opcode = opcode;
+    request->is_void = is_void != 0;
+    request->is_checked = is_checked != 0;
+
+    cookie = xpybFreelist_new(&xpybFreelist_cookie, cookie_type);
+    if (cookie != NULL)
+	result = xpybExt_send((xpybExt *)ext, request, (xpybCookie *)cookie, reply_type);
+
+    Py_XDECREF(cookie);
+    Py_DECREF(request);
+out:
+    if (xpybMemstat_enabled)
+	xpybMemstat_buffer(-buf->size);
+    buf->data = NULL;
+    buf->size = 0;
+    Py_DECREF(buf);
+    return result;
+}
+
+static xcb_generic_reply_t *
+xpybCAPI_get_reply(PyObject *cookie, double timeout)
+{
+    if (xpybCAPI_check_cookie(cookie) < 0)
+	return NULL;
+
+    return xpybCookie_get_reply((xpybCookie *)cookie,
+				timeout < 0 ? -1 : xpybModule_now() + timeout);
+}
+
+static PyObject *
+xpybCAPI_wrap_reply(PyObject *cookie, xcb_generic_reply_t *reply)
+{
+    if (xpybCAPI_check_cookie(cookie) < 0 || ((xpybCookie *)cookie)->reply_type == NULL) {
+	if (!PyErr_Occurred())
+	    PyErr_SetString(xpybExcept_base, "Request has no reply.");
+	free(reply);
+	return NULL;
+    }
+
+    return xpybCookie_wrap_reply((xpybCookie *)cookie, reply);
+}
+
+static PyObject *
+xpybCAPI_wrap_event(PyObject *conn, xcb_generic_event_t *event)
+{
+    if (xpybCAPI_check_conn(conn) < 0) {
+	free(event);
+	return NULL;
+    }
+
+    return xpybEvent_create((xpybConn *)conn, event);
+}
+
+static PyObject *
+xpybCAPI_wrap_error(PyObject *conn, xcb_generic_error_t *error)
+{
+    if (xpybCAPI_check_conn(conn) < 0) {
+	free(error);
+	return NULL;
+    }
+
+    return xpybError_exception((xpybConn *)conn, error);
+}
+
+static int
+xpybCAPI_extension_info(PyObject *conn, PyObject *key, int *major_opcode,
+			int *first_event, int *first_error)
+{
+    xpybExt *ext;
+
+    if (xpybCAPI_check_conn(conn) < 0)
+	return -1;
+
+    /* Same lookup and caching as conn(key) */
+    ext = (xpybExt *)PyObject_CallFunctionObjArgs(conn, key, NULL);
+    if (ext == NULL)
+	return -1;
+
+    *major_opcode = ext->major_opcode;
+    *first_event = ext->first_event;
+    *first_error = ext->first_error;
+    Py_DECREF(ext);
+    return 0;
+}
+
+static int
+xpybCAPI_generate_ids(PyObject *conn, uint32_t *ids, int n)
+{
+    if (n < 0) {
+	PyErr_SetString(PyExc_ValueError, "Count must be zero or positive.");
+	return -1;
+    }
+    if (xpybCAPI_check_conn(conn) < 0)
+	return -1;
+
+    if (xpybConn_alloc_xids((xpybConn *)conn, (unsigned int *)ids, n) < n) {
+	PyErr_SetString(xpybExcept_base, "No more free XID's available.");
+	return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Definition
+ */
+
+xpyb_CAPI_t xpybCAPI = {
+    &xpybConn_type,
+    XPYB_CAPI_VERSION,
+    &xpybCookie_type,
+    &xpybExt_type,
+    &xpybExtkey_type,
+    xpybCAPI_send_request,
+    xpybCAPI_get_reply,
+    xpybCAPI_wrap_reply,
+    xpybCAPI_wrap_event,
+    xpybCAPI_wrap_error,
+    xpybCAPI_extension_info,
+    xpybCAPI_generate_ids,
+};
@@ -0,0 +1,8 @@
+#ifndef XPYB_CAPI_H
+#define XPYB_CAPI_H
+
+#include "xpyb.h"
+
+extern xpyb_CAPI_t xpybCAPI;
+
+#endif
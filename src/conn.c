@@ -7,6 +7,15 @@
 #include "extkey.h"
 #include "ext.h"
 #include "conn.h"
+#include "rawbuf.h"
+#include "setupidx.h"
+#include "rtt.h"
+#include "phase.h"
+#include "lag.h"
+
+#include <frameobject.h>
+#include <errno.h>
+#include <poll.h>
 
 /*
  * Helpers
@@ -25,6 +34,384 @@ xpybConn_invalid(xpybConn *self)
     return 0;
 }
 
+/*
+ * XC-MISC, asked for a list of single free XIDs once libxcb has no range
+ * left to hand out.  Only the extension name is needed, so the extension
+ * library itself need not be present.
+ */
+static xcb_extension_t xpybConn_xc_misc = { "XC-MISC", 0 };
+
+#define XPYB_XC_MISC_GET_XID_LIST 2
+
+static uint32_t *
+xpybConn_get_xid_list(xpybConn *self, uint32_t count)
+{
+    const xcb_query_extension_reply_t *ext;
+    xcb_protocol_request_t req;
+    xcb_generic_error_t *e = NULL;
+    struct iovec parts[3];
+    uint32_t body[2], *reply;
+    unsigned int seq;
+
+    ext = xcb_get_extension_data(self->conn, &xpybConn_xc_misc);
+    if (ext == NULL || !ext->present)
+	return NULL;
+
+    req.count = 1;
+    req.ext = &xpybConn_xc_misc;
+    req.opcode = XPYB_XC_MISC_GET_XID_LIST;
+    req.isvoid = 0;
+
+    body[0] = 0;
+    body[1] = count;
+    parts[2].iov_base = body;
+    parts[2].iov_len = sizeof(body);
+
+    seq = xcb_send_request(self->conn, XCB_REQUEST_CHECKED, parts + 2, &req);
+    reply = xcb_wait_for_reply(self->conn, seq, &e);
+    free(e);
+    return reply;
+}
+
+/*
+ * Fills ids with up to n fresh XIDs and returns how many were found.
+ * xcb_generate_id() is the allocator, and it already asks XC-MISC for a
+ * new range when its own runs out.  Only when it fails are the remaining
+ * ids taken from a GetXIDList reply.  libxcb does not know about those,
+ * so a later range may hand one out again if it has not been used for a
+ * resource yet.  On a shortfall the ids found are kept for the next call
+ * rather than lost.
+ */
+unsigned int
+xpybConn_alloc_xids(xpybConn *self, unsigned int *ids, unsigned int n)
+{
+    unsigned int i = 0, xid, len;
+    uint32_t *reply;
+
+    while (i < n && self->priv->xid_spare_len > 0)
+	ids[i++] = self->priv->xid_spare[--self->priv->xid_spare_len];
+
+    while (i < n) {
+	xid = xcb_generate_id(self->conn);
+	if (xid == (unsigned int)-1)
+	    break;
+	ids[i++] = xid;
+    }
+
+    if (i < n) {
+	/* Both the failed range request and this one wait for a reply */
+	xpybConn_written(self);
+	reply = xpybConn_get_xid_list(self, n - i);
+	if (reply == NULL)
+	    goto out;
+	len = reply[2];
+	if (len > reply[1])
+	    len = reply[1];
+	if (len > n - i)
+	    len = n - i;
+	memcpy(ids + i, reply + 8, len * sizeof(*ids));
+	free(reply);
+	i += len;
+    }
+
+out:
+    if (i < n && i > 0) {
+	free(self->priv->xid_spare);
+	self->priv->xid_spare = malloc(i * sizeof(*ids));
+	if (self->priv->xid_spare != NULL) {
+	    memcpy(self->priv->xid_spare, ids, i * sizeof(*ids));
+	    self->priv->xid_spare_len = i;
+	}
+    }
+    return i;
+}
+
+/*
+ * Flush policy.  Requests are counted as they are sent so that the output
+ * buffer can be written once a request count, byte count or age limit is
+ * reached, rather than only when it fills up or on an explicit flush().
+ * A limit of zero is disabled.  Age is checked whenever the connection is
+ * used, since there is no timer behind it.
+ *
+ * libxcb also writes the buffer out by itself: when a request does not
+ * fit, and whenever it waits for a reply.  The counts are reset on the
+ * occasions xpyb can see, so they are an upper bound rather than exact.
+ */
+
+/* Size of the libxcb output queue */
+#define XPYB_OUTPUT_QUEUE 16384
+
+void
+xpybConn_written(xpybConn *self)
+{
+    self->priv->pending_requests = 0;
+    self->priv->pending_bytes = 0;
+}
+
+void
+xpybConn_flushed(xpybConn *self, int reason)
+{
+    self->priv->flushes[reason]++;
+    xpybConn_written(self);
+}
+
+static void
+xpybConn_flush_reason(xpybConn *self, int reason)
+{
+    xcb_flush(self->conn);
+    xpybConn_flushed(self, reason);
+}
+
+void
+xpybConn_check_latency(xpybConn *self)
+{
+    if (self->priv->pending_requests > 0 && self->priv->flush_max_latency > 0 &&
+	xpybModule_now() - self->priv->pending_since >= self->priv->flush_max_latency)
+	xpybConn_flush_reason(self, XPYB_FLUSH_LATENCY);
+}
+
+void
+xpybConn_sent(xpybConn *self, Py_ssize_t size)
+{
+    /* A request that does not fit is written out together with the queue */
+    if (self->priv->pending_bytes + size >= XPYB_OUTPUT_QUEUE) {
+	xpybConn_written(self);
+	return;
+    }
+
+    if (self->priv->pending_requests++ == 0 && self->priv->flush_max_latency > 0)
+	self->priv->pending_since = xpybModule_now();
+    self->priv->pending_bytes += size;
+
+    if (self->priv->flush_max_requests > 0 && self->priv->pending_requests >= self->priv->flush_max_requests)
+	xpybConn_flush_reason(self, XPYB_FLUSH_REQUESTS);
+    else if (self->priv->flush_max_bytes > 0 && self->priv->pending_bytes >= self->priv->flush_max_bytes)
+	xpybConn_flush_reason(self, XPYB_FLUSH_BYTES);
+    else
+	xpybConn_check_latency(self);
+}
+
+/* Blocking on the server writes the buffer out; count it as such. */
+void
+xpybConn_flush_for_wait(xpybConn *self)
+{
+    if (self->priv->pending_requests > 0)
+	xpybConn_flush_reason(self, XPYB_FLUSH_WAIT);
+}
+
+/*
+ * Deferred errors.  In this mode errors for unchecked requests are queued
+ * instead of being raised out of the event functions, annotated with the
+ * request that caused them.  Requests are remembered in a ring indexed by
+ * sequence number, so a lookup is a single slot compare.
+ */
+static void
+xpybConn_clear_history(xpybConn *self)
+{
+    int i;
+
+    for (i = 0; i < self->priv->history_len; i++) {
+	Py_CLEAR(self->priv->history[i].key);
+	Py_CLEAR(self->priv->history[i].code);
+    }
+    free(self->priv->history);
+    self->priv->history = NULL;
+    self->priv->history_len = 0;
+}
+
+/*
+ * Generated protocol modules live in the xcb package, so a frame whose
+ * module is named "xcb.<something>" is a generated request method.
+ */
+static int
+xpybConn_generated_frame(PyFrameObject *frame)
+{
+    PyObject *name = PyDict_GetItemString(frame->f_globals, "__name__");
+
+    return name != NULL && PyString_Check(name) &&
+	strncmp(PyString_AS_STRING(name), "xcb.", 4) == 0;
+}
+
+void
+xpybConn_record_request(xpybConn *self, unsigned int seq, PyObject *key, int opcode)
+{
+    xpybRequestRecord *rec = self->priv->history + seq % self->priv->history_len;
+    PyFrameObject *frame = PyEval_GetFrame();
+
+    /* Report the caller of a generated request method, not the method */
+    if (frame != NULL && frame->f_back != NULL && xpybConn_generated_frame(frame))
+	frame = frame->f_back;
+
+    rec->sequence = seq;
+    rec->opcode = opcode;
+    Py_INCREF(key);
+    Py_XDECREF(rec->key);
+    rec->key = key;
+    Py_CLEAR(rec->code);
+    if (frame != NULL) {
+	Py_INCREF(rec->code = (PyObject *)frame->f_code);
+	rec->line = PyFrame_GetLineNumber(frame);
+    }
+}
+
+static int
+xpybConn_annotate(xpybConn *self, PyObject *except, unsigned int seq)
+{
+    xpybRequestRecord *rec;
+    PyObject *ext = Py_None, *opcode = Py_None, *site = Py_None, *obj;
+    int rc = -1;
+
+    if (self->priv->history_len > 0) {
+	rec = self->priv->history + seq % self->priv->history_len;
+	if (rec->key != NULL && rec->sequence == seq) {
+	    if (rec->key != Py_None)
+		ext = (PyObject *)((xpybExtkey *)rec->key)->name;
+	    opcode = PyInt_FromLong(rec->opcode);
+	    if (opcode == NULL)
+		return -1;
+	    if (rec->code != NULL) {
+		site = Py_BuildValue("(Oi)", ((PyCodeObject *)rec->code)->co_filename, rec->line);
+		if (site == NULL)
+		    goto out;
+	    } else
+		Py_INCREF(site);
+	} else {
+	    Py_INCREF(opcode);
+	    Py_INCREF(site);
+	}
+    } else {
+	Py_INCREF(opcode);
+	Py_INCREF(site);
+    }
+
+    obj = PyLong_FromUnsignedLong(seq);
+    if (obj == NULL)
+	goto out;
+    if (PyObject_SetAttrString(except, "request_sequence", obj) < 0 ||
+	PyObject_SetAttrString(except, "request_extension", ext) < 0 ||
+	PyObject_SetAttrString(except, "request_opcode", opcode) < 0 ||
+	PyObject_SetAttrString(except, "request_site", site) < 0) {
+	Py_DECREF(obj);
+	goto out;
+    }
+    Py_DECREF(obj);
+    rc = 0;
+out:
+    Py_DECREF(opcode);
+    Py_XDECREF(site);
+    return rc;
+}
+
+/* Queues an error in deferred mode.  Takes ownership of e. */
+int
+xpybConn_defer_error(xpybConn *self, xcb_generic_error_t *e)
+{
+    unsigned int seq = e->full_sequence;
+    PyObject *except;
+    int rc;
+
+    if (PyList_GET_SIZE(self->priv->error_queue) >= self->priv->error_limit) {
+	self->priv->errors_dropped++;
+	free(e);
+	return 0;
+    }
+
+    except = xpybError_exception(self, e);
+    if (except == NULL)
+	return -1;
+
+    rc = xpybConn_annotate(self, except, seq);
+    if (rc == 0)
+	rc = PyList_Append(self->priv->error_queue, except);
+    Py_DECREF(except);
+    return rc;
+}
+
+/*
+ * Returns whether an asynchronous error matches one of the ignore rules,
+ * counting the hit.  This runs on the raw error, before any objects are
+ * made for it.
+ */
+int
+xpybConn_ignored(xpybConn *self, xcb_generic_error_t *e)
+{
+    xpybErrorRule *rule;
+    int i;
+
+    for (i = 0; i < self->priv->ignore_len; i++) {
+	rule = self->priv->ignore + i;
+	if (rule->code == e->error_code &&
+	    (rule->major < 0 || rule->major == e->major_code) &&
+	    (rule->minor < 0 || rule->minor == e->minor_code)) {
+	    rule->hits++;
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Timeouts.  A timeout argument of None means wait forever and becomes a
+ * negative deadline; otherwise the deadline is on the monotonic clock.
+ */
+int
+xpybConn_deadline(PyObject *timeout, double *deadline)
+{
+    double secs;
+
+    *deadline = -1;
+    if (timeout == NULL || timeout == Py_None)
+	return 0;
+
+    secs = PyFloat_AsDouble(timeout);
+    if (secs == -1.0 && PyErr_Occurred())
+	return -1;
+    if (secs < 0) {
+	PyErr_SetString(PyExc_ValueError, "Timeout must be zero or positive.");
+	return -1;
+    }
+
+    *deadline = xpybModule_now() + secs;
+    return 0;
+}
+
+/*
+ * Waits with the GIL released until the connection has input or the
+ * deadline passes.  Raises xcb.TimeoutException in the latter case.
+ */
+int
+xpybConn_wait_readable(xpybConn *self, double deadline)
+{
+    struct pollfd pfd;
+    double left;
+    int rc;
+
+    pfd.fd = xcb_get_file_descriptor(self->conn);
+    pfd.events = POLLIN;
+
+    for (;;) {
+	left = deadline - xpybModule_now();
+	if (left <= 0) {
+	    PyErr_SetString(xpybExcept_timeout, "Timed out waiting for the X server.");
+	    return -1;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	rc = poll(&pfd, 1, left > 86400 ? 86400000 : (int)(left * 1000) + 1);
+	Py_END_ALLOW_THREADS
+
+	if (rc > 0)
+	    return 0;
+	if (rc < 0 && errno != EINTR) {
+	    PyErr_SetFromErrno(PyExc_IOError);
+	    return -1;
+	}
+	if (PyErr_CheckSignals() < 0)
+	    return -1;
+    }
+}
+
 static int
 xpyb_parse_auth(const char *authstr, int authlen, xcb_auth_info_t *auth)
 {
@@ -48,6 +435,47 @@ xpyb_parse_auth(const char *authstr, int authlen, xcb_auth_info_t *auth)
 int
 xpybConn_init_struct(xpybConn *self, PyObject *core_type)
 {
+    self->priv->xid_spare = NULL;
+    self->priv->xid_spare_len = 0;
+    self->priv->flush_max_requests = 0;
+    self->priv->flush_max_bytes = 0;
+    self->priv->flush_max_latency = 0;
+    self->priv->pending_requests = 0;
+    self->priv->pending_bytes = 0;
+    self->priv->pending_since = 0;
+    memset(self->priv->flushes, 0, sizeof(self->priv->flushes));
+    self->priv->defer_errors = 0;
+    self->priv->error_limit = 0;
+    self->priv->error_queue = NULL;
+    self->priv->errors_dropped = 0;
+    self->priv->history = NULL;
+    self->priv->history_len = 0;
+    self->priv->ignore = NULL;
+    self->priv->ignore_len = 0;
+    self->priv->inflight_head = NULL;
+    self->priv->inflight_tail = NULL;
+    self->priv->max_inflight = 0;
+    self->priv->inflight = 0;
+    self->priv->inflight_peak = 0;
+    self->priv->inflight_drained = 0;
+    self->priv->inflight_blocked = 0;
+    self->priv->rtt_analyze = 0;
+    self->priv->rtt_stats = NULL;
+    self->priv->rtt_candidate = NULL;
+    self->priv->rtt_sent = 0;
+    self->priv->rtt_waited = 0;
+    self->priv->phase_timing = 0;
+    self->priv->phase_index = NULL;
+    self->priv->phases = NULL;
+    self->priv->phases_len = 0;
+    self->priv->phase_mark = 0;
+    self->priv->lag = NULL;
+    self->priv->lag_samples = 0;
+    self->priv->lag_synced = 0;
+    self->priv->lag_offset = 0;
+    self->priv->lag_last_type = -1;
+    self->priv->lag_last_time = 0;
+
     self->core = PyObject_CallFunctionObjArgs(core_type, self, NULL);
     if (self->core == NULL)
         return -1;
@@ -62,20 +490,28 @@ xpybConn_init_struct(xpybConn *self, PyObject *core_type)
 
     self->wrapped = 0;
     self->setup = NULL;
+    self->priv->setup_index = NULL;
     self->events = NULL;
     self->events_len = 0;
     self->errors = NULL;
     self->errors_len = 0;
+    memset(self->priv->freebufs, 0, sizeof(self->priv->freebufs));
+    memset(self->priv->freebufs_len, 0, sizeof(self->priv->freebufs_len));
+    self->priv->lazy = 0;
+    self->priv->ext_loaded = 0;
+    self->priv->startup_time = 0;
     return 0;
 }
 
 int
 xpybConn_init(xpybConn *self, PyObject *args, PyObject *kw)
 {
-    static char *kwlist[] = { "display", "fd", "auth", NULL };
+    static char *kwlist[] = { "display", "fd", "auth", "lazy", NULL };
     const char *displayname = NULL, *authstr = NULL;
     xcb_auth_info_t auth, *authptr = NULL;
+    PyObject *lazy = NULL;
     int authlen, fd = -1;
+    double start = xpybModule_now();
 
     /* Make sure core was set. */
     if (xpybModule_core == NULL) {
@@ -84,8 +520,8 @@ xpybConn_init(xpybConn *self, PyObject *args, PyObject *kw)
     }
 
     /* Parse arguments and allocate new connection object */
-    if (!PyArg_ParseTupleAndKeywords(args, kw, "|ziz#", kwlist, &displayname,
-				     &fd, &authstr, &authlen))
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|ziz#O", kwlist, &displayname,
+				     &fd, &authstr, &authlen, &lazy))
         return -1;
 
     /* Set up authorization */
@@ -108,19 +544,61 @@ xpybConn_init(xpybConn *self, PyObject *args, PyObject *kw)
         return -1;
     }
 
-    xpybConn_init_struct(self, (PyObject *)xpybModule_core);
+    if (xpybConn_init_struct(self, (PyObject *)xpybModule_core) < 0)
+	return -1;
+    self->priv->lazy = lazy && PyObject_IsTrue(lazy);
 
     /* Load extensions */
     if (xpybConn_setup(self) < 0)
 	return -1;
 
+    self->priv->startup_time = xpybModule_now() - start;
+    return 0;
+}
+
+/* Makes room in an event or error table for the codes of one module */
+static int
+xpybConn_grow_table(PyObject ***table, int *len, PyObject *types, long base)
+{
+    Py_ssize_t j = 0;
+    PyObject *num, *type, **newmem;
+    long code, newlen = *len;
+
+    while (PyDict_Next(types, &j, &num, &type)) {
+	code = base + PyInt_AS_LONG(num);
+	if (code >= newlen && code < 256)
+	    newlen = code + 1;
+    }
+    if (newlen == *len)
+	return 0;
+
+    newmem = realloc(*table, newlen * sizeof(PyObject *));
+    if (newmem == NULL) {
+	PyErr_NoMemory();
+	return -1;
+    }
+    memset(newmem + *len, 0, (newlen - *len) * sizeof(PyObject *));
+    *table = newmem;
+    *len = newlen;
+    return 0;
+}
+
+static int
+xpybConn_setup_helper(xpybConn *self, xpybExt *ext, PyObject *events, PyObject *errors)
+{
+    if (xpybConn_grow_table(&self->events, &self->events_len, events, ext->first_event) < 0 ||
+	xpybConn_grow_table(&self->errors, &self->errors_len, errors, ext->first_error) < 0)
+	return -1;
+
+    xpybResponse_fill_table(self->events, self->events_len, events, ext->first_event);
+    xpybResponse_fill_table(self->errors, self->errors_len, errors, ext->first_error);
     return 0;
 }
 
 static xpybExt *
 xpybConn_load_ext(xpybConn *self, PyObject *key)
 {
-    PyObject *type;
+    PyObject *type, *events, *errors;
     xpybExt *ext;
     const xcb_query_extension_reply_t *reply;
 
@@ -142,90 +620,102 @@ xpybConn_load_ext(xpybConn *self, PyObject *key)
 
 	/* Get the opcode and base numbers. */
 	reply = xcb_get_extension_data(self->conn, &((xpybExtkey *)key)->key);
+	if (reply == NULL) {
+	    PyErr_SetString(xpybExcept_conn, "Failed to query extension.");
+	    Py_DECREF(ext);
+	    return NULL;
+	}
 	ext->present = reply->present;
 	ext->major_opcode = reply->major_opcode;
 	ext->first_event = reply->first_event;
 	ext->first_error = reply->first_error;
 
-	if (PyDict_SetItem(self->extcache, key, (PyObject *)ext) < 0)
+	if (PyDict_SetItem(self->extcache, key, (PyObject *)ext) < 0) {
+	    Py_DECREF(ext);
 	    return NULL;
+	}
+
+	/* Fill in its part of the event and error tables. */
+	events = PyDict_GetItem(xpybModule_ext_events, key);
+	errors = PyDict_GetItem(xpybModule_ext_errors, key);
+	if (ext->present && events && errors)
+	    if (xpybConn_setup_helper(self, ext, events, errors) < 0) {
+		Py_DECREF(ext);
+		return NULL;
+	    }
     }
 
     return ext;
 }
 
-static int
-xpybConn_setup_helper(xpybConn *self, xpybExt *ext, PyObject *events, PyObject *errors)
+/*
+ * Generated modules register event and error table entries as callables
+ * returning the real entry, so that the classes are only created once
+ * they are needed.  Replaces such an entry with its value.
+ */
+int
+xpybConn_resolve_entry(PyObject **entry)
 {
-    Py_ssize_t j = 0;
-    unsigned char opcode, newlen;
-    PyObject *num, *type, **newmem;
+    PyObject *value = PyObject_CallObject(*entry, NULL);
 
-    while (PyDict_Next(events, &j, &num, &type)) {
-	opcode = ext->first_event + PyInt_AS_LONG(num);
-	if (opcode >= self->events_len) {
-	    newlen = opcode + 1;
-	    newmem = realloc(self->events, newlen * sizeof(PyObject *));
-	    if (newmem == NULL)
-		return -1;
-	    memset(newmem + self->events_len, 0, (newlen - self->events_len) * sizeof(PyObject *));
-	    self->events = newmem;
-	    self->events_len = newlen;
-	}
-	Py_INCREF(self->events[opcode] = type);
-    }
+    if (value == NULL)
+	return -1;
 
-    j = 0;
-    while (PyDict_Next(errors, &j, &num, &type)) {
-	opcode = ext->first_error + PyInt_AS_LONG(num);
-	if (opcode >= self->errors_len) {
-	    newlen = opcode + 1;
-	    newmem = realloc(self->errors, newlen * sizeof(PyObject *));
-	    if (newmem == NULL)
-		return -1;
-	    memset(newmem + self->errors_len, 0, (newlen - self->errors_len) * sizeof(PyObject *));
-	    self->errors = newmem;
-	    self->errors_len = newlen;
-	}
-	Py_INCREF(self->errors[opcode] = type);
+    Py_DECREF(*entry);
+    *entry = value;
+    return 0;
+}
+
+/*
+ * Loads every registered extension not yet loaded on this connection.
+ * The QueryExtension requests for all of them go out before waiting on
+ * the first reply, so startup costs one round trip rather than one per
+ * extension.
+ */
+int
+xpybConn_load_all(xpybConn *self)
+{
+    PyObject *key, *type;
+    xpybExt *ext;
+    Py_ssize_t i = 0, count = PyDict_Size(xpybModule_extdict);
+
+    if (self->priv->ext_loaded == count)
+	return 0;
+
+    while (PyDict_Next(xpybModule_extdict, &i, &key, &type))
+	if (PyDict_GetItem(self->extcache, key) == NULL)
+	    xcb_prefetch_extension_data(self->conn, &((xpybExtkey *)key)->key);
+
+    i = 0;
+    while (PyDict_Next(xpybModule_extdict, &i, &key, &type)) {
+	ext = xpybConn_load_ext(self, key);
+	if (ext == NULL)
+	    return -1;
+	Py_DECREF(ext);
     }
 
+    self->priv->ext_loaded = count;
     return 0;
 }
 
 int
 xpybConn_setup(xpybConn *self)
 {
-    PyObject *key, *events, *errors;
-    xpybExt *ext;
+    PyObject *key, *type;
     Py_ssize_t i = 0;
-    int rc = -1;
 
-    ext = (xpybExt *)self->core;
-    events = xpybModule_core_events;
-    errors = xpybModule_core_errors;
-    if (xpybConn_setup_helper(self, ext, events, errors) < 0)
+    if (xpybConn_setup_helper(self, (xpybExt *)self->core,
+			      xpybModule_core_events, xpybModule_core_errors) < 0)
 	return -1;
 
-    ext = NULL;
-    while (PyDict_Next(xpybModule_ext_events, &i, &key, &events)) {
-	errors = PyDict_GetItem(xpybModule_ext_errors, key);
-	if (errors == NULL)
-	    goto out;
+    if (!self->priv->lazy)
+	return xpybConn_load_all(self);
 
-	Py_XDECREF(ext);
-	ext = xpybConn_load_ext(self, key);
-	if (ext == NULL)
-	    goto out;
-	if (ext->present)
-	    if (xpybConn_setup_helper(self, ext, events, errors) < 0)
-		goto out;
-    }
+    /* Lazy: only send the queries; tables are filled in on first use. */
+    while (PyDict_Next(xpybModule_extdict, &i, &key, &type))
+	xcb_prefetch_extension_data(self->conn, &((xpybExtkey *)key)->key);
 
-    rc = 0;
-out:
-    Py_XDECREF(ext);
-    return rc;
+    return 0;
 }
 
 /*
@@ -235,7 +725,18 @@ out:
 static PyObject *
 xpybConn_new(PyTypeObject *self, PyObject *args, PyObject *kw)
 {
-    return PyType_GenericNew(self, args, kw);
+    xpybConn *conn = (xpybConn *)PyType_GenericNew(self, args, kw);
+
+    if (conn == NULL)
+	return NULL;
+
+    conn->priv = calloc(1, sizeof(*conn->priv));
+    if (conn->priv == NULL) {
+	Py_DECREF(conn);
+	return PyErr_NoMemory();
+    }
+
+    return (PyObject *)conn;
 }
 
 static void
@@ -248,6 +749,20 @@ xpybConn_dealloc(xpybConn *self)
     Py_CLEAR(self->setup);
     Py_CLEAR(self->extcache);
 
+    if (self->priv != NULL) {
+	if (self->priv->setup_index != NULL)
+	    ((xpybSetupidx *)self->priv->setup_index)->conn = NULL;
+	Py_CLEAR(self->priv->setup_index);
+	Py_CLEAR(self->priv->error_queue);
+	Py_CLEAR(self->priv->rtt_stats);
+	Py_CLEAR(self->priv->rtt_candidate);
+	xpybPhase_clear(self);
+	xpybLag_clear(self);
+	xpybConn_clear_history(self);
+	free(self->priv->ignore);
+	free(self->priv->xid_spare);
+    }
+
     if (self->conn && !self->wrapped)
 	xcb_disconnect(self->conn);
 
@@ -258,52 +773,13 @@ xpybConn_dealloc(xpybConn *self)
 
     free(self->events);
     free(self->errors);
+    if (self->priv != NULL) {
+	xpybRawbuf_clear_pool(self);
+	free(self->priv);
+    }
     self->ob_type->tp_free((PyObject *)self);
 }
 
-static PyObject *
-xpybConn_getattro(xpybConn *self, PyObject *obj)
-{
-    const char *name = PyString_AS_STRING(obj);
-    PyMethodDef *mptr = xpybConn_type.tp_methods;
-    PyMemberDef *sptr = xpybConn_type.tp_members;
-    PyObject *result;
-
-    while (mptr && mptr->ml_name)
-	if (strcmp(name, (mptr++)->ml_name) == 0)
-	    goto out2;
-    while (sptr && sptr->name)
-	if (strcmp(name, (sptr++)->name) == 0)
-	    goto out2;
-	
-    Py_XINCREF(result = PyDict_GetItem(self->dict, obj));
-    if (result != NULL || PyErr_Occurred())
-	return result;
-
-    return xpybConn_type.tp_base->tp_getattro((PyObject *)self, obj);
-out2:
-    return PyObject_GenericGetAttr((PyObject *)self, obj);
-}
-
-static int
-xpybConn_setattro(xpybConn *self, PyObject *obj, PyObject *val)
-{
-    const char *name = PyString_AS_STRING(obj);
-    PyMethodDef *mptr = xpybConn_type.tp_methods;
-    PyMemberDef *sptr = xpybConn_type.tp_members;
-
-    while (mptr && mptr->ml_name)
-	if (strcmp(name, (mptr++)->ml_name) == 0)
-	    goto out2;
-    while (sptr && sptr->name)
-	if (strcmp(name, (sptr++)->name) == 0)
-	    goto out2;
-
-    return val ? PyDict_SetItem(self->dict, obj, val) : PyDict_DelItem(self->dict, obj);
-out2:
-    return PyObject_GenericSetAttr((PyObject *)self, obj, val);
-}
-
 static PyObject *
 xpybConn_call(xpybConn *self, PyObject *args, PyObject *kw)
 {
@@ -319,6 +795,8 @@ xpybConn_call(xpybConn *self, PyObject *args, PyObject *kw)
 
     /* Check our dictionary of cached values */
     ext = xpybConn_load_ext(self, key);
+    if (ext == NULL)
+	return NULL;
     if (!ext->present) {
 	PyErr_SetString(xpybExcept_ext, "Extension not present on server.");
 	Py_DECREF(ext);
@@ -333,6 +811,64 @@ xpybConn_call(xpybConn *self, PyObject *args, PyObject *kw)
  * Members
  */
 
+static PyObject *
+xpybConn_get_startup_time(xpybConn *self, void *closure)
+{
+    return PyFloat_FromDouble(self->priv->startup_time);
+}
+
+static PyObject *
+xpybConn_get_max_inflight(xpybConn *self, void *closure)
+{
+    return PyInt_FromLong(self->priv->max_inflight);
+}
+
+static int
+xpybConn_set_max_inflight(xpybConn *self, PyObject *value, void *closure)
+{
+    long max;
+
+    if (value == NULL) {
+	PyErr_SetString(PyExc_TypeError, "Cannot delete max_inflight.");
+	return -1;
+    }
+    max = PyInt_AsLong(value);
+    if (max == -1 && PyErr_Occurred())
+	return -1;
+    if (max < INT_MIN || max > INT_MAX) {
+	PyErr_SetString(PyExc_OverflowError, "Value out of range.");
+	return -1;
+    }
+
+    self->priv->max_inflight = max;
+    return 0;
+}
+
+static PyObject *
+xpybConn_get_errors_dropped(xpybConn *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->priv->errors_dropped);
+}
+
+static PyGetSetDef xpybConn_getset[] = {
+    { "startup_time",
+      (getter)xpybConn_get_startup_time,
+      NULL,
+      "Seconds taken to connect and load extensions" },
+
+    { "max_inflight",
+      (getter)xpybConn_get_max_inflight,
+      (setter)xpybConn_set_max_inflight,
+      "Maximum number of outstanding replies, or 0 for no limit" },
+
+    { "errors_dropped",
+      (getter)xpybConn_get_errors_dropped,
+      NULL,
+      "Deferred errors dropped because the queue was full" },
+
+    { NULL } /* terminator */
+};
+
 static PyMemberDef xpybConn_members[] = {
     { "pref_screen",
       T_INT,
@@ -423,51 +959,334 @@ xpybConn_get_setup(xpybConn *self, PyObject *args)
 }
 
 static PyObject *
-xpybConn_wait_for_event(xpybConn *self, PyObject *args)
+xpybConn_get_setup_index(xpybConn *self, PyObject *args)
 {
+    if (xpybConn_invalid(self))
+	return NULL;
+
+    if (self->priv->setup_index == NULL)
+	self->priv->setup_index = xpybSetupidx_create(self);
+
+    Py_XINCREF(self->priv->setup_index);
+    return self->priv->setup_index;
+}
+
+static PyObject *
+xpybConn_wait_for_event(xpybConn *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "timeout", NULL };
     xcb_generic_event_t *data;
+    PyObject *timeout = NULL;
+    double deadline;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O", kwlist, &timeout))
+	return NULL;
+    if (xpybConn_deadline(timeout, &deadline) < 0)
+	return NULL;
 
     if (xpybConn_invalid(self))
 	return NULL;
+    if (self->priv->lag != NULL)
+	xpybLag_handled(self);
+
+    for (;;) {
+	xpybConn_flush_for_wait(self);
+	if (deadline < 0)
+	    data = xcb_wait_for_event(self->conn);
+	else
+	    while ((data = xcb_poll_for_event(self->conn)) == NULL) {
+		if (xcb_connection_has_error(self->conn))
+		    break;
+		xcb_flush(self->conn);
+		if (xpybConn_wait_readable(self, deadline) < 0)
+		    return NULL;
+	    }
+
+	if (data == NULL) {
+	    PyErr_SetString(PyExc_IOError, "I/O error on X server connection.");
+	    return NULL;
+	}
+
+	if (data->response_type != 0)
+	    return xpybEvent_create(self, data);
+
+	if (xpybConn_ignored(self, (xcb_generic_error_t *)data)) {
+	    free(data);
+	    continue;
+	}
+	if (!self->priv->defer_errors) {
+	    xpybError_set(self, (xcb_generic_error_t *)data);
+	    return NULL;
+	}
+	if (xpybConn_defer_error(self, (xcb_generic_error_t *)data) < 0)
+	    return NULL;
+    }
+}
 
-    data = xcb_wait_for_event(self->conn);
+static PyObject *
+xpybConn_poll_for_event(xpybConn *self, PyObject *args)
+{
+    xcb_generic_event_t *data;
 
-    if (data == NULL) {
-	PyErr_SetString(PyExc_IOError, "I/O error on X server connection.");
+    if (xpybConn_invalid(self))
 	return NULL;
+    if (self->priv->lag != NULL)
+	xpybLag_handled(self);
+
+    xpybConn_check_latency(self);
+
+    for (;;) {
+	data = xcb_poll_for_event(self->conn);
+
+	if (data == NULL) {
+	    if (xpybConn_invalid(self))
+		return NULL;
+	    else
+		Py_RETURN_NONE;
+	}
+
+	if (data->response_type != 0)
+	    return xpybEvent_create(self, data);
+
+	if (xpybConn_ignored(self, (xcb_generic_error_t *)data)) {
+	    free(data);
+	    continue;
+	}
+	if (!self->priv->defer_errors) {
+	    xpybError_set(self, (xcb_generic_error_t *)data);
+	    return NULL;
+	}
+	if (xpybConn_defer_error(self, (xcb_generic_error_t *)data) < 0)
+	    return NULL;
     }
+}
+
+static PyObject *
+xpybConn_set_defer_errors(xpybConn *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "enabled", "limit", "history", NULL };
+    PyObject *enabled = Py_True;
+    Py_ssize_t limit = 1024;
+    int history = 256, on;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|Oni", kwlist, &enabled, &limit, &history))
+	return NULL;
 
-    if (data->response_type == 0) {
-	xpybError_set(self, (xcb_generic_error_t *)data);
+    on = PyObject_IsTrue(enabled);
+    if (on < 0)
+	return NULL;
+    if (limit < 1 || history < 0) {
+	PyErr_SetString(PyExc_ValueError, "Limit must be positive and history zero or positive.");
 	return NULL;
     }
 
-    return xpybEvent_create(self, data);
+    if (on && self->priv->error_queue == NULL) {
+	self->priv->error_queue = PyList_New(0);
+	if (self->priv->error_queue == NULL)
+	    return NULL;
+    }
+
+    if (!on)
+	history = 0;
+    if (history != self->priv->history_len) {
+	xpybConn_clear_history(self);
+	if (history > 0) {
+	    self->priv->history = calloc(history, sizeof(*self->priv->history));
+	    if (self->priv->history == NULL)
+		return PyErr_NoMemory();
+	    self->priv->history_len = history;
+	}
+    }
+
+    self->priv->defer_errors = on;
+    self->priv->error_limit = limit;
+    Py_RETURN_NONE;
+}
+
+static int
+xpybConn_opcode_arg(PyObject *obj, int *opcode)
+{
+    if (obj == Py_None) {
+	*opcode = -1;
+	return 0;
+    }
+
+    *opcode = PyInt_AsLong(obj);
+    if (*opcode == -1 && PyErr_Occurred())
+	return -1;
+    if (*opcode < 0 || *opcode > 255) {
+	PyErr_SetString(PyExc_ValueError, "Codes must be between 0 and 255.");
+	return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+xpybConn_ignore_errors(xpybConn *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "error_code", "major_opcode", "minor_opcode", NULL };
+    PyObject *code, *major = Py_None, *minor = Py_None;
+    xpybErrorRule rule, *newmem;
+    int i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|OO", kwlist, &code, &major, &minor))
+	return NULL;
+
+    if (code == Py_None) {
+	PyErr_SetString(PyExc_ValueError, "An error code is required.");
+	return NULL;
+    }
+    if (xpybConn_opcode_arg(code, &rule.code) < 0 ||
+	xpybConn_opcode_arg(major, &rule.major) < 0 ||
+	xpybConn_opcode_arg(minor, &rule.minor) < 0)
+	return NULL;
+    rule.hits = 0;
+
+    for (i = 0; i < self->priv->ignore_len; i++)
+	if (self->priv->ignore[i].code == rule.code && self->priv->ignore[i].major == rule.major &&
+	    self->priv->ignore[i].minor == rule.minor)
+	    Py_RETURN_NONE;
+
+    newmem = realloc(self->priv->ignore, (self->priv->ignore_len + 1) * sizeof(*newmem));
+    if (newmem == NULL)
+	return PyErr_NoMemory();
+    self->priv->ignore = newmem;
+    self->priv->ignore[self->priv->ignore_len++] = rule;
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-xpybConn_poll_for_event(xpybConn *self, PyObject *args)
+xpybConn_ignored_errors(xpybConn *self, PyObject *args)
 {
-    xcb_generic_event_t *data;
+    PyObject *list, *item;
+    xpybErrorRule *rule;
+    int i;
 
-    if (xpybConn_invalid(self))
+    list = PyList_New(self->priv->ignore_len);
+    if (list == NULL)
+	return NULL;
+
+    for (i = 0; i < self->priv->ignore_len; i++) {
+	rule = self->priv->ignore + i;
+	item = Py_BuildValue("(iNNk)", rule->code,
+			     rule->major < 0 ? Py_BuildValue("") : PyInt_FromLong(rule->major),
+			     rule->minor < 0 ? Py_BuildValue("") : PyInt_FromLong(rule->minor),
+			     rule->hits);
+	if (item == NULL) {
+	    Py_DECREF(list);
+	    return NULL;
+	}
+	PyList_SET_ITEM(list, i, item);
+    }
+
+    return list;
+}
+
+static PyObject *
+xpybConn_clear_ignored_errors(xpybConn *self, PyObject *args)
+{
+    free(self->priv->ignore);
+    self->priv->ignore = NULL;
+    self->priv->ignore_len = 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybConn_inflight_stats(xpybConn *self, PyObject *args)
+{
+    return Py_BuildValue("{snsnsisksk}",
+			 "inflight", self->priv->inflight,
+			 "peak", self->priv->inflight_peak,
+			 "max", self->priv->max_inflight,
+			 "drained", self->priv->inflight_drained,
+			 "blocked", self->priv->inflight_blocked);
+}
+
+static PyObject *
+xpybConn_analyze_round_trips(xpybConn *self, PyObject *args)
+{
+    PyObject *enabled = Py_True;
+    int on;
+
+    if (!PyArg_ParseTuple(args, "|O", &enabled))
 	return NULL;
 
-    data = xcb_poll_for_event(self->conn);
+    on = PyObject_IsTrue(enabled);
+    if (on < 0 || xpybRtt_enable(self, on) < 0)
+	return NULL;
+
+    Py_RETURN_NONE;
+}
 
-    if (data == NULL) {
-        if (xpybConn_invalid(self))
-            return NULL;
-        else
-            Py_RETURN_NONE;
+static PyObject *
+xpybConn_round_trip_report(xpybConn *self, PyObject *args)
+{
+    return xpybRtt_report(self);
+}
+
+static PyObject *
+xpybConn_time_phases(xpybConn *self, PyObject *args)
+{
+    PyObject *enabled = Py_True;
+    int on;
+
+    if (!PyArg_ParseTuple(args, "|O", &enabled))
+	return NULL;
+
+    on = PyObject_IsTrue(enabled);
+    if (on < 0 || xpybPhase_enable(self, on) < 0)
+	return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybConn_phase_report(xpybConn *self, PyObject *args)
+{
+    return xpybPhase_report(self);
+}
+
+static PyObject *
+xpybConn_track_event_lag(xpybConn *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "samples", NULL };
+    int samples = 1024;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|i", kwlist, &samples))
+	return NULL;
+    if (samples < 0) {
+	PyErr_SetString(PyExc_ValueError, "Samples must be zero or positive.");
+	return NULL;
     }
 
-    if (data->response_type == 0) {
-	xpybError_set(self, (xcb_generic_error_t *)data);
+    if (xpybLag_enable(self, samples) < 0)
+	return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybConn_event_lag_report(xpybConn *self, PyObject *args)
+{
+    return xpybLag_report(self);
+}
+
+static PyObject *
+xpybConn_drain_errors(xpybConn *self, PyObject *args)
+{
+    PyObject *errors;
+
+    if (self->priv->error_queue == NULL)
+	return PyList_New(0);
+
+    errors = self->priv->error_queue;
+    self->priv->error_queue = PyList_New(0);
+    if (self->priv->error_queue == NULL) {
+	self->priv->error_queue = errors;
 	return NULL;
     }
 
-    return xpybEvent_create(self, data);
+    return errors;
 }
 
 static PyObject *
@@ -476,10 +1295,49 @@ xpybConn_flush(xpybConn *self, PyObject *args)
     if (xpybConn_invalid(self))
 	return NULL;
 
-    xcb_flush(self->conn);
+    xpybConn_flush_reason(self, XPYB_FLUSH_MANUAL);
     Py_RETURN_NONE;
 }
 
+static PyObject *
+xpybConn_set_flush_policy(xpybConn *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "max_requests", "max_bytes", "max_latency", NULL };
+    int max_requests = 0;
+    Py_ssize_t max_bytes = 0;
+    double max_latency = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|ind", kwlist,
+				     &max_requests, &max_bytes, &max_latency))
+	return NULL;
+
+    if (max_requests < 0 || max_bytes < 0 || max_latency < 0) {
+	PyErr_SetString(PyExc_ValueError, "Flush limits must be zero or positive.");
+	return NULL;
+    }
+
+    self->priv->flush_max_requests = max_requests;
+    self->priv->flush_max_bytes = max_bytes;
+    self->priv->flush_max_latency = max_latency;
+    if (self->priv->pending_requests > 0)
+	self->priv->pending_since = xpybModule_now();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybConn_flush_stats(xpybConn *self, PyObject *args)
+{
+    return Py_BuildValue("{sksksksksksisn}",
+			 "manual", self->priv->flushes[XPYB_FLUSH_MANUAL],
+			 "requests", self->priv->flushes[XPYB_FLUSH_REQUESTS],
+			 "bytes", self->priv->flushes[XPYB_FLUSH_BYTES],
+			 "latency", self->priv->flushes[XPYB_FLUSH_LATENCY],
+			 "wait", self->priv->flushes[XPYB_FLUSH_WAIT],
+			 "pending_requests", self->priv->pending_requests,
+			 "pending_bytes", self->priv->pending_bytes);
+}
+
 static PyObject *
 xpybConn_generate_id(xpybConn *self)
 {
@@ -488,8 +1346,7 @@ xpybConn_generate_id(xpybConn *self)
     if (xpybConn_invalid(self))
 	return NULL;
 
-    xid = xcb_generate_id(self->conn);
-    if (xid == (unsigned int)-1) {
+    if (xpybConn_alloc_xids(self, &xid, 1) < 1) {
 	PyErr_SetString(xpybExcept_base, "No more free XID's available.");
 	return NULL;
     }
@@ -497,6 +1354,50 @@ xpybConn_generate_id(xpybConn *self)
     return Py_BuildValue("I", xid);
 }
 
+static PyObject *
+xpybConn_generate_ids(xpybConn *self, PyObject *args)
+{
+    unsigned int *ids;
+    PyObject *list, *obj;
+    int i, n;
+
+    if (!PyArg_ParseTuple(args, "i", &n))
+	return NULL;
+
+    if (n < 0) {
+	PyErr_SetString(PyExc_ValueError, "Count must be zero or positive.");
+	return NULL;
+    }
+    if (xpybConn_invalid(self))
+	return NULL;
+
+    ids = malloc((n ? n : 1) * sizeof(*ids));
+    if (ids == NULL)
+	return PyErr_NoMemory();
+
+    if (xpybConn_alloc_xids(self, ids, n) < n) {
+	free(ids);
+	PyErr_SetString(xpybExcept_base, "No more free XID's available.");
+	return NULL;
+    }
+
+    list = PyList_New(n);
+    if (list == NULL)
+	goto out;
+
+    for (i = 0; i < n; i++) {
+	obj = PyInt_FromSize_t(ids[i]);
+	if (obj == NULL) {
+	    Py_CLEAR(list);
+	    goto out;
+	}
+	PyList_SET_ITEM(list, i, obj);
+    }
+out:
+    free(ids);
+    return list;
+}
+
 static PyObject *
 xpybConn_disconnect(xpybConn *self, PyObject *args)
 {
@@ -532,9 +1433,14 @@ static PyMethodDef xpybConn_methods[] = {
       METH_NOARGS,
       "Accessor for the connection information returned by the server." },
 
+    { "get_setup_index",
+      (PyCFunction)xpybConn_get_setup_index,
+      METH_NOARGS,
+      "Returns an index for looking up screens, visuals and pixmap formats by number." },
+
     { "wait_for_event",
       (PyCFunction)xpybConn_wait_for_event,
-      METH_NOARGS,
+      METH_VARARGS | METH_KEYWORDS,
       "Returns the next event or raises the next error from the server." },
 
     { "poll_for_event",
@@ -547,11 +1453,86 @@ static PyMethodDef xpybConn_methods[] = {
       METH_NOARGS,
       "Forces any buffered output to be written to the server." },
 
+    { "set_flush_policy",
+      (PyCFunction)xpybConn_set_flush_policy,
+      METH_VARARGS | METH_KEYWORDS,
+      "Sets the request count, byte count and age in seconds at which buffered output is flushed." },
+
+    { "defer_errors",
+      (PyCFunction)xpybConn_set_defer_errors,
+      METH_VARARGS | METH_KEYWORDS,
+      "Queues errors of unchecked requests for drain_errors() instead of raising them." },
+
+    { "drain_errors",
+      (PyCFunction)xpybConn_drain_errors,
+      METH_NOARGS,
+      "Returns and clears the list of deferred errors." },
+
+    { "ignore_errors",
+      (PyCFunction)xpybConn_ignore_errors,
+      METH_VARARGS | METH_KEYWORDS,
+      "Drops asynchronous errors with the given code and, optionally, request opcodes." },
+
+    { "ignored_errors",
+      (PyCFunction)xpybConn_ignored_errors,
+      METH_NOARGS,
+      "Returns the ignore rules as (error_code, major_opcode, minor_opcode, hits) tuples." },
+
+    { "clear_ignored_errors",
+      (PyCFunction)xpybConn_clear_ignored_errors,
+      METH_NOARGS,
+      "Removes all ignore rules." },
+
+    { "inflight_stats",
+      (PyCFunction)xpybConn_inflight_stats,
+      METH_NOARGS,
+      "Returns a dictionary describing outstanding replies." },
+
+    { "analyze_round_trips",
+      (PyCFunction)xpybConn_analyze_round_trips,
+      METH_VARARGS,
+      "Starts or stops looking for replies that are waited for too early." },
+
+    { "round_trip_report",
+      (PyCFunction)xpybConn_round_trip_report,
+      METH_NOARGS,
+      "Returns the round trips that could have been pipelined, by request method." },
+
+    { "time_phases",
+      (PyCFunction)xpybConn_time_phases,
+      METH_VARARGS,
+      "Starts or stops timing the phases of each request type." },
+
+    { "phase_report",
+      (PyCFunction)xpybConn_phase_report,
+      METH_NOARGS,
+      "Returns cumulative encode, send, wait and decode times by request type." },
+
+    { "track_event_lag",
+      (PyCFunction)xpybConn_track_event_lag,
+      METH_VARARGS | METH_KEYWORDS,
+      "Starts or stops recording event ages and handler times." },
+
+    { "event_lag_report",
+      (PyCFunction)xpybConn_event_lag_report,
+      METH_NOARGS,
+      "Returns event age and handler time percentiles by event code." },
+
+    { "flush_stats",
+      (PyCFunction)xpybConn_flush_stats,
+      METH_NOARGS,
+      "Returns a dictionary counting flushes by what caused them." },
+
     { "generate_id",
       (PyCFunction)xpybConn_generate_id,
       METH_NOARGS,
       "Allocates an XID for a new object." },
 
+    { "generate_ids",
+      (PyCFunction)xpybConn_generate_ids,
+      METH_VARARGS,
+      "Allocates a list of XIDs for new objects." },
+
     { "disconnect",
       (PyCFunction)xpybConn_disconnect,
       METH_NOARGS,
@@ -572,13 +1553,13 @@ PyTypeObject xpybConn_type = {
     .tp_new = xpybConn_new,
     .tp_dealloc = (destructor)xpybConn_dealloc,
     .tp_init = (initproc)xpybConn_init,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB connection object",
     .tp_methods = xpybConn_methods,
     .tp_members = xpybConn_members,
+    .tp_getset = xpybConn_getset,
     .tp_call = (ternaryfunc)xpybConn_call,
-    .tp_getattro = (getattrofunc)xpybConn_getattro,
-    .tp_setattro = (setattrofunc)xpybConn_setattro
+    .tp_dictoffset = offsetof(xpybConn, dict)
 };
 
 
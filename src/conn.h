@@ -3,11 +3,125 @@
 
 #include "xpyb.h"
 
+/* Size classes of the event and error buffer freelists (32 to 4096 bytes) */
+#define XPYB_BUFCLASSES 8
+
+/* Causes of an output flush, counted per connection */
+#define XPYB_FLUSH_MANUAL 0
+#define XPYB_FLUSH_REQUESTS 1
+#define XPYB_FLUSH_BYTES 2
+#define XPYB_FLUSH_LATENCY 3
+#define XPYB_FLUSH_WAIT 4
+#define XPYB_FLUSH_REASONS 5
+
+/* A request remembered so that a later error can be traced back to it */
+typedef struct {
+    unsigned int sequence;
+    int opcode;
+    PyObject *key;
+    PyObject *code;
+    int line;
+} xpybRequestRecord;
+
+/* Cumulative phase times of one request type, in seconds */
+typedef struct {
+    PyObject *key;
+    unsigned long requests;
+    unsigned long replies;
+    double encode;
+    double send;
+    double wait;
+    double decode;
+} xpybPhaseEntry;
+
+/* Recent event ages and handler times of one event type, in seconds */
+typedef struct {
+    unsigned long count;
+    unsigned long aged;
+    unsigned long handled;
+    double *ages;
+    double *handlers;
+} xpybLagEntry;
+
+/* An error that is dropped on arrival; -1 matches any opcode */
+typedef struct {
+    int code;
+    int major;
+    int minor;
+    unsigned long hits;
+} xpybErrorRule;
+
+/*
+ * Connection state that is not part of the installed header, so that it
+ * can change without breaking modules built against the C API.
+ */
+typedef struct xpybConnPrivate {
+    void *freebufs[XPYB_BUFCLASSES];
+    int freebufs_len[XPYB_BUFCLASSES];
+    int lazy;
+    Py_ssize_t ext_loaded;
+    double startup_time;
+    unsigned int *xid_spare;
+    unsigned int xid_spare_len;
+    int flush_max_requests;
+    Py_ssize_t flush_max_bytes;
+    double flush_max_latency;
+    int pending_requests;
+    Py_ssize_t pending_bytes;
+    double pending_since;
+    unsigned long flushes[XPYB_FLUSH_REASONS];
+    int defer_errors;
+    Py_ssize_t error_limit;
+    PyObject *error_queue;
+    unsigned long errors_dropped;
+    xpybRequestRecord *history;
+    int history_len;
+    xpybErrorRule *ignore;
+    int ignore_len;
+    struct xpybCookie *inflight_head;
+    struct xpybCookie *inflight_tail;
+    int max_inflight;
+    Py_ssize_t inflight;
+    Py_ssize_t inflight_peak;
+    unsigned long inflight_drained;
+    unsigned long inflight_blocked;
+    int rtt_analyze;
+    PyObject *rtt_stats;
+    PyObject *rtt_candidate;
+    unsigned long rtt_sent;
+    unsigned long rtt_waited;
+    int phase_timing;
+    PyObject *phase_index;
+    xpybPhaseEntry *phases;
+    int phases_len;
+    double phase_mark;
+    xpybLagEntry *lag;
+    int lag_samples;
+    int lag_synced;
+    unsigned int lag_offset;
+    int lag_last_type;
+    double lag_last_time;
+    PyObject *setup_index;
+} xpybConnPrivate;
+
 extern PyTypeObject xpybConn_type;
 
 int xpybConn_invalid(xpybConn *self);
 xpybConn *xpybConn_create(PyObject *core_type);
 int xpybConn_setup(xpybConn *self);
+int xpybConn_load_all(xpybConn *self);
+int xpybConn_resolve_entry(PyObject **entry);
+void xpybConn_written(xpybConn *self);
+void xpybConn_flushed(xpybConn *self, int reason);
+void xpybConn_sent(xpybConn *self, Py_ssize_t size);
+void xpybConn_flush_for_wait(xpybConn *self);
+void xpybConn_check_latency(xpybConn *self);
+void xpybConn_record_request(xpybConn *self, unsigned int seq, PyObject *key, int opcode);
+int xpybConn_defer_error(xpybConn *self, xcb_generic_error_t *e);
+int xpybConn_ignored(xpybConn *self, xcb_generic_error_t *e);
+int xpybConn_deadline(PyObject *timeout, double *deadline);
+int xpybConn_wait_readable(xpybConn *self, double deadline);
+unsigned int xpybConn_alloc_xids(xpybConn *self, unsigned int *ids, unsigned int n);
 
 int xpybConn_modinit(PyObject *m);
 
@@ -4,11 +4,313 @@
 #include "cookie.h"
 #include "error.h"
 #include "reply.h"
+#include "rawbuf.h"
+#include "freelist.h"
+#include "rtt.h"
+#include "phase.h"
+#include "memstat.h"
+#include "probes.h"
 
 /*
  * Helpers
  */
 
+/*
+ * Cookies of requests with replies are kept on a per-connection list,
+ * oldest first, until their reply has been taken from libxcb.
+ */
+void
+xpybCookie_track(xpybCookie *self)
+{
+    xpybConn *conn = self->conn;
+
+    self->prev = conn->priv->inflight_tail;
+    self->next = NULL;
+    if (conn->priv->inflight_tail)
+	conn->priv->inflight_tail->next = self;
+    else
+	conn->priv->inflight_head = self;
+    conn->priv->inflight_tail = self;
+    self->inflight = 1;
+
+    if (++conn->priv->inflight > conn->priv->inflight_peak)
+	conn->priv->inflight_peak = conn->priv->inflight;
+}
+
+static void
+xpybCookie_untrack(xpybCookie *self)
+{
+    xpybConn *conn = self->conn;
+
+    if (!self->inflight)
+	return;
+
+    if (self->prev)
+	self->prev->next = self->next;
+    else
+	conn->priv->inflight_head = self->next;
+    if (self->next)
+	self->next->prev = self->prev;
+    else
+	conn->priv->inflight_tail = self->prev;
+
+    self->prev = self->next = NULL;
+    self->inflight = 0;
+    conn->priv->inflight--;
+}
+
+/*
+ * Called before sending a request with a reply when the connection is at
+ * its in-flight limit.  Replies that have already arrived are moved into
+ * their cookies; if that is not enough, waits for the oldest ones.
+ */
+int
+xpybCookie_throttle(xpybConn *conn)
+{
+    xpybCookie *cookie;
+    void *reply;
+    xcb_generic_error_t *error;
+
+    while ((cookie = conn->priv->inflight_head) != NULL) {
+	if (!xcb_poll_for_reply(conn->conn, cookie->cookie.sequence, &reply, &error))
+	    break;
+	cookie->data = reply;
+	cookie->error = error;
+	xpybCookie_untrack(cookie);
+	conn->priv->inflight_drained++;
+    }
+
+    if (conn->priv->inflight < conn->priv->max_inflight)
+	return 0;
+
+    xpybConn_flush_for_wait(conn);
+    while (conn->priv->inflight >= conn->priv->max_inflight && (cookie = conn->priv->inflight_head) != NULL) {
+	cookie->data = xcb_wait_for_reply(conn->conn, cookie->cookie.sequence, &cookie->error);
+	xpybCookie_untrack(cookie);
+	conn->priv->inflight_blocked++;
+	if (cookie->data == NULL && cookie->error == NULL) {
+	    PyErr_SetString(PyExc_IOError, "I/O error on X server connection.");
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Polls for the reply to a request until it arrives or the deadline
+ * passes.  On timeout the request is left alone so it can be waited for
+ * again.  Returns 1 when the request has completed, 0 on timeout or error.
+ */
+static int
+xpybCookie_poll_reply(xpybConn *conn, unsigned int seq, double deadline,
+		      void **reply, xcb_generic_error_t **error)
+{
+    xcb_flush(conn->conn);
+
+    while (!xcb_poll_for_reply(conn->conn, seq, reply, error)) {
+	if (xcb_connection_has_error(conn->conn)) {
+	    PyErr_SetString(PyExc_IOError, "I/O error on X server connection.");
+	    return 0;
+	}
+	if (xpybConn_wait_readable(conn, deadline) < 0)
+	    return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Makes sure every earlier request has completed, the way libxcb does
+ * before checking a request, but without blocking past the deadline.
+ */
+static int
+xpybCookie_sync(xpybConn *conn, double deadline)
+{
+    xcb_protocol_request_t req;
+    xcb_generic_error_t *error = NULL;
+    struct iovec parts[3];
+    uint32_t body = 0;
+    void *reply = NULL;
+    unsigned int seq;
+
+    req.count = 1;
+    req.ext = NULL;
+    req.opcode = XCB_GET_INPUT_FOCUS;
+    req.isvoid = 0;
+    parts[2].iov_base = &body;
+    parts[2].iov_len = sizeof(body);
+
+    seq = xcb_send_request(conn->conn, 0, parts + 2, &req);
+    if (!xpybCookie_poll_reply(conn, seq, deadline, &reply, &error)) {
+	xcb_discard_reply(conn->conn, seq);
+	return -1;
+    }
+
+    free(reply);
+    free(error);
+    return 0;
+}
+
+xcb_generic_reply_t *
+xpybCookie_get_reply(xpybCookie *self, double deadline)
+{
+    xcb_generic_error_t *error;
+    xcb_generic_reply_t *data;
+    double start = 0, waited = 0;
+    int timed;
+
+    /* Check arguments and connection. */
+    if (self->request->is_void) {
+	PyErr_SetString(xpybExcept_base, "Request has no reply.");
+	return NULL;
+    }
+
+    /* A reply left over from an earlier call is handed out first. */
+    if (self->data != NULL) {
+	data = self->data;
+	self->data = NULL;
+	return data;
+    }
+    if (self->error != NULL) {
+	error = self->error;
+	self->error = NULL;
+	xpybError_set(self->conn, error);
+	return NULL;
+    }
+
+    if (xpybConn_invalid(self->conn))
+	return NULL;
+
+    /* Make XCB call */
+    XPYB_PROBE1(reply__begin, self->cookie.sequence);
+    timed = self->rtt_trace != NULL || self->phase_entry || XPYB_PROBE_ENABLED(reply__end);
+    if (timed)
+	start = xpybModule_now();
+    xpybConn_flush_for_wait(self->conn);
+    if (deadline < 0)
+	data = xcb_wait_for_reply(self->conn->conn, self->cookie.sequence, &error);
+    else if (!xpybCookie_poll_reply(self->conn, self->cookie.sequence, deadline,
+				    (void **)&data, &error))
+	return NULL;
+    xpybCookie_untrack(self);
+    if (timed)
+	waited = xpybModule_now() - start;
+    XPYB_PROBE2(reply__end, self->cookie.sequence, (long)(waited * 1e6));
+    if (self->rtt_trace != NULL && self->conn->priv->rtt_analyze)
+	xpybRtt_replied(self->conn, self, waited);
+    if (self->phase_entry)
+	xpybPhase_add(self->conn, self, 1, waited);
+    if (xpybError_set(self->conn, error))
+	return NULL;
+    if (data == NULL) {
+	PyErr_SetString(PyExc_IOError, "I/O error on X server connection.");
+	return NULL;
+    }
+
+    return data;
+}
+
+/*
+ * Takes ownership of the reply and builds the cookie's reply type over
+ * it, without copying.
+ */
+PyObject *
+xpybCookie_wrap_reply(xpybCookie *self, xcb_generic_reply_t *data)
+{
+    PyObject *shim, *reply;
+    double start = 0;
+
+    if (self->phase_entry)
+	start = xpybModule_now();
+
+    /* Hand the reply memory to a shim object without copying it */
+    shim = xpybRawbuf_create(data, 32 + data->length * 4);
+    if (shim == NULL) {
+	free(data);
+	return NULL;
+    }
+
+    /* Call the reply type object to get a new xcb.Reply instance */
+    reply = PyObject_CallFunctionObjArgs((PyObject *)self->reply_type, shim, NULL);
+    Py_DECREF(shim);
+    if (self->phase_entry)
+	xpybPhase_add(self->conn, self, 0, xpybModule_now() - start);
+    return reply;
+}
+
+static int
+xpybCookie_compare(const void *a, const void *b)
+{
+    unsigned int x = (*(xpybCookie **)a)->cookie.sequence;
+    unsigned int y = (*(xpybCookie **)b)->cookie.sequence;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+ * Checks many void requests at once.  libxcb only syncs with the server
+ * for a request that has not completed yet, so checking the most recent
+ * request of each connection first makes the rest free.  Returns a
+ * dictionary mapping each failed cookie to its exception.
+ */
+PyObject *
+xpybCookie_check_all(PyObject *cookies)
+{
+    PyObject *seq, *result = NULL, *except;
+    xcb_generic_error_t *error;
+    xpybCookie **sorted, *cookie;
+    Py_ssize_t i, n;
+
+    seq = PySequence_Fast(cookies, "Argument must be a sequence of cookies.");
+    if (seq == NULL)
+	return NULL;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    sorted = malloc((n ? n : 1) * sizeof(*sorted));
+    if (sorted == NULL) {
+	Py_DECREF(seq);
+	return PyErr_NoMemory();
+    }
+
+    for (i = 0; i < n; i++) {
+	cookie = (xpybCookie *)PySequence_Fast_GET_ITEM(seq, i);
+	if (!PyObject_TypeCheck(cookie, &xpybCookie_type) ||
+	    !(cookie->request->is_void && cookie->request->is_checked)) {
+	    PyErr_SetString(xpybExcept_base, "Request is not void and checked.");
+	    goto out;
+	}
+	if (xpybConn_invalid(cookie->conn))
+	    goto out;
+	sorted[i] = cookie;
+    }
+
+    qsort(sorted, n, sizeof(*sorted), xpybCookie_compare);
+
+    result = PyDict_New();
+    if (result == NULL)
+	goto out;
+
+    for (i = 0; i < n; i++) {
+	cookie = sorted[i];
+	xpybConn_flush_for_wait(cookie->conn);
+	error = xcb_request_check(cookie->conn->conn, cookie->cookie);
+	if (error == NULL)
+	    continue;
+
+	except = xpybError_exception(cookie->conn, error);
+	if (except == NULL || PyDict_SetItem(result, (PyObject *)cookie, except) < 0) {
+	    Py_XDECREF(except);
+	    Py_CLEAR(result);
+	    goto out;
+	}
+	Py_DECREF(except);
+    }
+out:
+    free(sorted);
+    Py_DECREF(seq);
+    return result;
+}
 
 /*
  * Infrastructure
@@ -17,19 +319,33 @@
 static PyObject *
 xpybCookie_new(PyTypeObject *self, PyObject *args, PyObject *kw)
 {
-    return PyType_GenericNew(self, args, kw);
+    return xpybFreelist_new(&xpybFreelist_cookie, self);
 }
 
 static void
 xpybCookie_dealloc(xpybCookie *self)
 {
-    if (self->conn && self->conn->conn)
+    /*
+     * Discarding an unchecked void request also throws away its error.
+     * That is the long-standing behavior, but with deferred errors the
+     * error is wanted in the queue, so such requests are left alone.
+     */
+    if (self->conn && self->conn->conn &&
+	!(self->conn->priv->defer_errors && self->request &&
+	  self->request->is_void && !self->request->is_checked))
 	xcb_discard_reply(self->conn->conn, self->cookie.sequence);
+    if (self->conn)
+	xpybCookie_untrack(self);
+    if (self->pinned && xpybMemstat_enabled)
+	xpybMemstat_pin(self->pinned, -1);
 
+    free(self->data);
+    free(self->error);
+    Py_CLEAR(self->rtt_trace);
     Py_CLEAR(self->reply_type);
     Py_CLEAR(self->request);
     Py_CLEAR(self->conn);
-    self->ob_type->tp_free((PyObject *)self);
+    xpybFreelist_free(&xpybFreelist_cookie, (PyObject *)self);
 }
 
 
@@ -43,9 +359,18 @@ xpybCookie_dealloc(xpybCookie *self)
  */
 
 static PyObject *
-xpybCookie_check(xpybCookie *self, PyObject *args)
+xpybCookie_check(xpybCookie *self, PyObject *args, PyObject *kw)
 {
-    xcb_generic_error_t *error;
+    static char *kwlist[] = { "timeout", NULL };
+    xcb_generic_error_t *error = NULL;
+    PyObject *timeout = NULL;
+    double deadline;
+    void *reply = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O", kwlist, &timeout))
+	return NULL;
+    if (xpybConn_deadline(timeout, &deadline) < 0)
+	return NULL;
 
     if (!(self->request->is_void && self->request->is_checked)) {
 	PyErr_SetString(xpybExcept_base, "Request is not void and checked.");
@@ -54,7 +379,16 @@ xpybCookie_check(xpybCookie *self, PyObject *args)
     if (xpybConn_invalid(self->conn))
 	return NULL;
 
-    error = xcb_request_check(self->conn->conn, self->cookie);
+    xpybConn_flush_for_wait(self->conn);
+    if (deadline < 0)
+	error = xcb_request_check(self->conn->conn, self->cookie);
+    else if (xcb_poll_for_reply(self->conn->conn, self->cookie.sequence, &reply, &error))
+	free(reply);
+    else if (xpybCookie_sync(self->conn, deadline) < 0)
+	return NULL;
+    else
+	error = xcb_request_check(self->conn->conn, self->cookie);
+
     if (xpybError_set(self->conn, error))
 	return NULL;
 
@@ -62,63 +396,82 @@ xpybCookie_check(xpybCookie *self, PyObject *args)
 }
 
 static PyObject *
-xpybCookie_reply(xpybCookie *self, PyObject *args)
+xpybCookie_reply(xpybCookie *self, PyObject *args, PyObject *kw)
 {
-    xcb_generic_error_t *error;
+    static char *kwlist[] = { "timeout", NULL };
     xcb_generic_reply_t *data;
-    PyObject *shim, *reply;
+    PyObject *timeout = NULL;
+    double deadline;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O", kwlist, &timeout))
+	return NULL;
+    if (xpybConn_deadline(timeout, &deadline) < 0)
+	return NULL;
+
+    data = xpybCookie_get_reply(self, deadline);
+    if (data == NULL)
+	return NULL;
+
+    return xpybCookie_wrap_reply(self, data);
+}
+
+static PyObject *
+xpybCookie_reply_into(xpybCookie *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "buffer", "timeout", NULL };
+    xcb_generic_reply_t *data;
+    PyObject *obj, *timeout = NULL;
     void *buf;
-    Py_ssize_t len;
+    Py_ssize_t len, size;
+    double deadline, start = 0;
 
-    /* Check arguments and connection. */
-    if (self->request->is_void) {
-	PyErr_SetString(xpybExcept_base, "Request has no reply.");
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|O", kwlist, &obj, &timeout))
 	return NULL;
-    }
-    if (xpybConn_invalid(self->conn))
+    if (xpybConn_deadline(timeout, &deadline) < 0)
+	return NULL;
+    if (PyObject_AsWriteBuffer(obj, &buf, &len) < 0)
 	return NULL;
 
-    /* Make XCB call */
-    data = xcb_wait_for_reply(self->conn->conn, self->cookie.sequence, &error);
-    if (xpybError_set(self->conn, error))
+    data = xpybCookie_get_reply(self, deadline);
+    if (data == NULL)
 	return NULL;
-    if (data == NULL) {
-	PyErr_SetString(PyExc_IOError, "I/O error on X server connection.");
+
+    /* Keep the reply for another try if it does not fit. */
+    size = 32 + (Py_ssize_t)data->length * 4;
+    if (len < size) {
+	self->data = data;
+	PyErr_Format(PyExc_ValueError, "Buffer too small for reply "
+		     "(need %zd bytes, got %zd).", size, len);
 	return NULL;
     }
 
-    /* Create a shim protocol object */
-    shim = PyBuffer_New(32 + data->length * 4);
-    if (shim == NULL)
-	goto err1;
-    if (PyObject_AsWriteBuffer(shim, &buf, &len) < 0)
-        goto err2;
-    memcpy(buf, data, len);
+    if (self->phase_entry)
+	start = xpybModule_now();
+    memcpy(buf, data, size);
     free(data);
+    if (self->phase_entry)
+	xpybPhase_add(self->conn, self, 0, xpybModule_now() - start);
 
-    /* Call the reply type object to get a new xcb.Reply instance */
-    reply = PyObject_CallFunctionObjArgs((PyObject *)self->reply_type, shim, NULL);
-    Py_DECREF(shim);
-    return reply;
-
-err2:
-    Py_DECREF(shim);
-err1:
-    free(data);
-    return NULL;
+    /* Only the generic reply header is decoded; the payload stays in place. */
+    return PyObject_CallFunction((PyObject *)&xpybReply_type, "Onn", obj, (Py_ssize_t)0, size);
 }
 
 static PyMethodDef xpybCookie_methods[] = {
     { "check",
       (PyCFunction)xpybCookie_check,
-      METH_NOARGS,
+      METH_VARARGS | METH_KEYWORDS,
       "Raise an error if one occurred on the request." },
 
     { "reply",
       (PyCFunction)xpybCookie_reply,
-      METH_NOARGS,
+      METH_VARARGS | METH_KEYWORDS,
       "Return the reply or raise an error." },
 
+    { "reply_into",
+      (PyCFunction)xpybCookie_reply_into,
+      METH_VARARGS | METH_KEYWORDS,
+      "Copy the reply into a writable buffer and return its generic header." },
+
     { NULL } /* terminator */
 };
 
@@ -133,7 +486,7 @@ PyTypeObject xpybCookie_type = {
     .tp_basicsize = sizeof(xpybCookie),
     .tp_new = xpybCookie_new,
     .tp_dealloc = (destructor)xpybCookie_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic cookie object",
     .tp_methods = xpybCookie_methods
 };
@@ -5,16 +5,31 @@
 #include "request.h"
 #include "reply.h"
 
-typedef struct {
+typedef struct xpybCookie {
     PyObject_HEAD
     xpybConn *conn;
     xpybRequest *request;
     PyTypeObject *reply_type;
     xcb_void_cookie_t cookie;
+    xcb_generic_reply_t *data;
+    xcb_generic_error_t *error;
+    struct xpybCookie *prev;
+    struct xpybCookie *next;
+    int inflight;
+    PyObject *rtt_trace;
+    unsigned long rtt_index;
+    int phase_entry;
+    Py_ssize_t pinned;
 } xpybCookie;
 
 extern PyTypeObject xpybCookie_type;
 
+PyObject *xpybCookie_check_all(PyObject *cookies);
+xcb_generic_reply_t *xpybCookie_get_reply(xpybCookie *self, double deadline);
+PyObject *xpybCookie_wrap_reply(xpybCookie *self, xcb_generic_reply_t *data);
+void xpybCookie_track(xpybCookie *self);
+int xpybCookie_throttle(xpybConn *conn);
+
 int xpybCookie_modinit(PyObject *m);
 
 #endif
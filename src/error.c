@@ -2,30 +2,56 @@
 #include "except.h"
 #include "response.h"
 #include "error.h"
+#include "probes.h"
+#include "rawbuf.h"
 
 /*
  * Helpers
  */
 
+/*
+ * Takes ownership of the error, if any.
+ */
 int
 xpybError_set(xpybConn *conn, xcb_generic_error_t *e)
 {
     unsigned char opcode;
-    PyObject *shim, *error, *type, *except;
+    PyObject *error, *type, *except;
+    xpybRawbuf *shim;
 
     type = (PyObject *)&xpybError_type;
     except = xpybExcept_proto;
 
     if (e) {
+	XPYB_PROBE4(error, e->error_code, e->major_code, e->minor_code, e->full_sequence);
 	opcode = e->error_code;
+	if (opcode >= conn->errors_len || conn->errors[opcode] == NULL)
+	    if (xpybConn_load_all(conn) < 0) {
+		free(e);
+		return 1;
+	    }
 	if (opcode < conn->errors_len && conn->errors[opcode] != NULL) {
+	    if (!PyTuple_Check(conn->errors[opcode]))
+		if (xpybConn_resolve_entry(conn->errors + opcode) < 0) {
+		    free(e);
+		    return 1;
+		}
+	    if (!PyTuple_Check(conn->errors[opcode]) || PyTuple_GET_SIZE(conn->errors[opcode]) != 2) {
+		PyErr_SetString(xpybExcept_base, "Error table entry is not a (type, exception) pair.");
+		free(e);
+		return 1;
+	    }
 	    type = PyTuple_GET_ITEM(conn->errors[opcode], 0);
 	    except = PyTuple_GET_ITEM(conn->errors[opcode], 1);
 	}
 
-	shim = PyBuffer_FromMemory(e, sizeof(*e));
-	if (shim == NULL)
+	shim = xpybRawbuf_alloc(conn, 32);
+	if (shim == NULL) {
+	    free(e);
 	    return 1;
+	}
+	memcpy(shim->data, e, 32);
+	free(e);
 
 	error = PyObject_CallFunctionObjArgs(type, shim, NULL);
 	if (error != NULL)
@@ -36,6 +62,28 @@ xpybError_set(xpybConn *conn, xcb_generic_error_t *e)
     return 0;
 }
 
+/*
+ * Builds the exception xpybError_set() would raise for an error, and
+ * returns it instead of raising it.
+ */
+PyObject *
+xpybError_exception(xpybConn *conn, xcb_generic_error_t *e)
+{
+    PyObject *type, *value, *tb;
+
+    xpybError_set(conn, e);
+    PyErr_Fetch(&type, &value, &tb);
+    PyErr_NormalizeException(&type, &value, &tb);
+    if (type == NULL || !PyErr_GivenExceptionMatches(type, xpybExcept_proto)) {
+	PyErr_Restore(type, value, tb);
+	return NULL;
+    }
+
+    Py_DECREF(type);
+    Py_XDECREF(tb);
+    return value;
+}
+
 
 /*
  * Infrastructure
@@ -47,21 +95,30 @@ xpybError_set(xpybConn *conn, xcb_generic_error_t *e)
  */
 
 static PyObject *
-xpybError_getattro(PyObject *self, PyObject *obj)
+xpybError_get_code(PyObject *self, void *closure)
 {
-    const char *name = PyString_AS_STRING(obj);
     const xcb_generic_error_t *data;
     Py_ssize_t size;
 
-    if (PyObject_AsReadBuffer(self, (const void **)&data, &size) < 0)
+    if (xpybProtobj_data((xpybProtobj *)self, (const void **)&data, &size) < 0)
 	return NULL;
+    if (size < 2) {
+	PyErr_SetString(xpybExcept_base, "Error buffer too short.");
+	return NULL;
+    }
 
-    if (strcmp(name, "code") == 0)
-	return Py_BuildValue("B", data->error_code);
-
-    return xpybError_type.tp_base->tp_getattro(self, obj);
+    return PyInt_FromLong(data->error_code);
 }
 
+static PyGetSetDef xpybError_getset[] = {
+    { "code",
+      (getter)xpybError_get_code,
+      NULL,
+      "Error code" },
+
+    { NULL } /* terminator */
+};
+
 
 /*
  * Definition
@@ -71,10 +128,10 @@ PyTypeObject xpybError_type = {
     PyObject_HEAD_INIT(NULL)
     .tp_name = "xcb.Error",
     .tp_basicsize = sizeof(xpybError),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic error object",
     .tp_base = &xpybResponse_type,
-    .tp_getattro = xpybError_getattro
+    .tp_getset = xpybError_getset
 };
 
 
@@ -11,6 +11,7 @@ typedef struct {
 extern PyTypeObject xpybError_type;
 
 int xpybError_set(xpybConn *conn, xcb_generic_error_t *e);
+PyObject *xpybError_exception(xpybConn *conn, xcb_generic_error_t *e);
 
 int xpybError_modinit(PyObject *m);
 
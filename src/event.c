@@ -2,29 +2,87 @@
 #include "except.h"
 #include "response.h"
 #include "event.h"
+#include "lag.h"
+#include "probes.h"
+#include "rawbuf.h"
+
+#ifndef XCB_GE_GENERIC
+#define XCB_GE_GENERIC 35
+#endif
 
 /*
  * Helpers
  */
 
+/*
+ * Takes ownership of the event and wraps it in the given type.  It is
+ * copied into a buffer laid out as on the wire, pooled when a connection
+ * is given: libxcb stores the extra data of a generic event after its
+ * full_sequence field, so that data is moved back to offset 32.
+ */
 PyObject *
-xpybEvent_create(xpybConn *conn, xcb_generic_event_t *e)
+xpybEvent_wrap(PyObject *type, xpybConn *conn, xcb_generic_event_t *e)
 {
     unsigned char opcode = e->response_type & 0x7f;
-    PyObject *shim, *event, *type = (PyObject *)&xpybEvent_type;
+    PyObject *event;
+    xpybRawbuf *shim;
+    Py_ssize_t extra = 0;
+    void *data;
 
-    if (opcode < conn->events_len && conn->events[opcode] != NULL)
-	type = conn->events[opcode];
+    if (opcode == XCB_GE_GENERIC)
+	extra = (Py_ssize_t)((xcb_ge_event_t *)e)->length * 4;
 
-    shim = PyBuffer_FromMemory(e, sizeof(*e));
-    if (shim == NULL)
+    if (conn != NULL)
+	shim = xpybRawbuf_alloc(conn, 32 + extra);
+    else if ((data = malloc(32 + extra)) == NULL)
+	shim = (xpybRawbuf *)PyErr_NoMemory();
+    else if ((shim = (xpybRawbuf *)xpybRawbuf_create(data, 32 + extra)) == NULL)
+	free(data);
+    if (shim == NULL) {
+	free(e);
 	return NULL;
+    }
+    memcpy(shim->data, e, 32);
+    memcpy((char *)shim->data + 32, e + 1, extra);
+    free(e);
 
     event = PyObject_CallFunctionObjArgs(type, shim, NULL);
     Py_DECREF(shim);
     return event;
 }
 
+/*
+ * Takes ownership of an event received on the connection and wraps it in
+ * the class the connection has registered for its code.
+ */
+PyObject *
+xpybEvent_create(xpybConn *conn, xcb_generic_event_t *e)
+{
+    unsigned char opcode = e->response_type & 0x7f;
+    PyObject *type = (PyObject *)&xpybEvent_type;
+
+    XPYB_PROBE2(event, e->response_type, e->full_sequence);
+
+    /* Unknown code: it may belong to an extension not loaded yet */
+    if (opcode >= conn->events_len || conn->events[opcode] == NULL)
+	if (xpybConn_load_all(conn) < 0) {
+	    free(e);
+	    return NULL;
+	}
+    if (opcode < conn->events_len && conn->events[opcode] != NULL) {
+	if (!PyType_Check(conn->events[opcode]))
+	    if (xpybConn_resolve_entry(conn->events + opcode) < 0) {
+		free(e);
+		return NULL;
+	    }
+	type = conn->events[opcode];
+    }
+
+    if (conn->priv->lag != NULL)
+	xpybLag_event(conn, e);
+    return xpybEvent_wrap(type, conn, e);
+}
+
 
 /*
  * Infrastructure
@@ -44,7 +102,7 @@ PyTypeObject xpybEvent_type = {
     PyObject_HEAD_INIT(NULL)
     .tp_name = "xcb.Event",
     .tp_basicsize = sizeof(xpybEvent),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic event object",
     .tp_base = &xpybResponse_type
 };
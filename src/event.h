@@ -10,6 +10,7 @@ typedef struct {
 
 extern PyTypeObject xpybEvent_type;
 
+PyObject *xpybEvent_wrap(PyObject *type, xpybConn *conn, xcb_generic_event_t *e);
 PyObject *xpybEvent_create(xpybConn *conn, xcb_generic_event_t *e);
 
 int xpybEvent_modinit(PyObject *m);
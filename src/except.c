@@ -5,6 +5,7 @@ PyObject *xpybExcept_ext;
 PyObject *xpybExcept_base;
 PyObject *xpybExcept_conn;
 PyObject *xpybExcept_proto;
+PyObject *xpybExcept_timeout;
 
 int xpybExcept_modinit(PyObject *m)
 {
@@ -36,6 +37,13 @@ int xpybExcept_modinit(PyObject *m)
     if (PyModule_AddObject(m, "ProtocolException", xpybExcept_proto) < 0)
 	return -1;
 
+    xpybExcept_timeout = PyErr_NewException("xcb.TimeoutException", xpybExcept_base, NULL);
+    if (xpybExcept_timeout == NULL)
+	return -1;
+    Py_INCREF(xpybExcept_timeout);
+    if (PyModule_AddObject(m, "TimeoutException", xpybExcept_timeout) < 0)
+	return -1;
+
     return 0;
 }
 
@@ -5,6 +5,7 @@ extern PyObject *xpybExcept_base;
 extern PyObject *xpybExcept_conn;
 extern PyObject *xpybExcept_ext;
 extern PyObject *xpybExcept_proto;
+extern PyObject *xpybExcept_timeout;
 
 int xpybExcept_modinit(PyObject *m);
 
@@ -6,11 +6,99 @@
 #include "cookie.h"
 #include "reply.h"
 #include "request.h"
+#include "rtt.h"
+#include "phase.h"
+#include "memstat.h"
+#include "probes.h"
 
 /*
  * Helpers
  */
 
+/*
+ * Sends an encoded request and fills in the cookie for it.  Shared by
+ * send_request() and the C API.
+ */
+PyObject *
+xpybExt_send(xpybExt *self, xpybRequest *request, xpybCookie *cookie, PyTypeObject *reply)
+{
+    xcb_protocol_request_t xcb_req;
+    struct iovec xcb_parts[4];
+    unsigned int seq;
+    int flags;
+    const void *data;
+    Py_ssize_t size;
+    double start = 0;
+
+    if (!request->is_void)
+	if (reply == NULL || !PyType_IsSubtype(reply, &xpybReply_type)) {
+	    PyErr_SetString(xpybExcept_base, "Reply type missing or not derived from xcb.Reply.");
+	    return NULL;
+	}
+
+    if (cookie->conn != NULL) {
+	PyErr_SetString(xpybExcept_base, "Cookie has already been used.");
+	return NULL;
+    }
+
+    /* Check the connection */
+    if (xpybConn_invalid(self->conn))
+	return NULL;
+
+    /* Set up request structure */
+    xcb_req.count = 2;
+    xcb_req.ext = (self->key != (xpybExtkey *)Py_None) ? &self->key->key : 0;
+    xcb_req.opcode = request->opcode;
+    xcb_req.isvoid = request->is_void;
+
+    /* Allocate and fill in data strings */
+    if (xpybProtobj_data((xpybProtobj *)request, &data, &size) < 0)
+	return NULL;
+    xcb_parts[2].iov_base = (void *)data;
+    xcb_parts[2].iov_len = size;
+    xcb_parts[3].iov_base = 0;
+    xcb_parts[3].iov_len = -xcb_parts[2].iov_len & 3;
+
+    /* Hold back if too many replies are outstanding */
+    if (!request->is_void && self->conn->priv->max_inflight > 0 &&
+	self->conn->priv->inflight >= self->conn->priv->max_inflight)
+	if (xpybCookie_throttle(self->conn) < 0)
+	    return NULL;
+
+    /* Make request call */
+    flags = request->is_checked ? XCB_REQUEST_CHECKED : 0;
+    if (self->conn->priv->phase_timing)
+	start = xpybModule_now();
+    seq = xcb_send_request(self->conn->conn, flags, xcb_parts + 2, &xcb_req);
+    XPYB_PROBE4(request__send,
+		xcb_req.ext ? xcb_req.ext->name : "", request->opcode, seq,
+		size + xcb_parts[3].iov_len);
+    xpybConn_sent(self->conn, size + xcb_parts[3].iov_len);
+    if (self->conn->priv->history_len > 0)
+	xpybConn_record_request(self->conn, seq, (PyObject *)self->key, request->opcode);
+
+    /* Set up cookie */
+    Py_INCREF(cookie->conn = self->conn);
+    Py_INCREF((PyObject *)(cookie->request = request));
+    Py_XINCREF(cookie->reply_type = reply);
+    cookie->cookie.sequence = seq;
+    if (xpybMemstat_enabled) {
+	cookie->pinned = size;
+	xpybMemstat_pin(size, 1);
+    }
+    if (!request->is_void)
+	xpybCookie_track(cookie);
+    if (self->conn->priv->rtt_analyze)
+	xpybRtt_sent(self->conn, cookie);
+    if (self->conn->priv->phase_timing)
+	xpybPhase_sent(self->conn, cookie,
+		       (self->key != (xpybExtkey *)Py_None) ? (PyObject *)self->key->name : Py_None,
+		       request->opcode, start, xpybModule_now());
+
+    Py_INCREF(cookie);
+    return (PyObject *)cookie;
+}
+
 
 /*
  * Infrastructure
@@ -81,6 +169,21 @@ static PyMemberDef xpybExt_members[] = {
     { NULL } /* terminator */
 };
 
+static PyObject *
+xpybExt_get_phase_timing(xpybExt *self, void *closure)
+{
+    return PyBool_FromLong(self->conn != NULL && self->conn->priv->phase_timing);
+}
+
+static PyGetSetDef xpybExt_getset[] = {
+    { "phase_timing",
+      (getter)xpybExt_get_phase_timing,
+      NULL,
+      "Whether the connection is timing request phases" },
+
+    { NULL } /* terminator */
+};
+
 
 /*
  * Methods
@@ -93,12 +196,6 @@ xpybExt_send_request(xpybExt *self, PyObject *args, PyObject *kw)
     xpybRequest *request;
     xpybCookie *cookie;
     PyTypeObject *reply = NULL;
-    xcb_protocol_request_t xcb_req;
-    struct iovec xcb_parts[4];
-    unsigned int seq;
-    int flags;
-    const void *data;
-    Py_ssize_t size;
 
     /* Parse and check arguments */
     if (!PyArg_ParseTupleAndKeywords(args, kw, "O!O!|O!", kwlist,
@@ -107,45 +204,24 @@ xpybExt_send_request(xpybExt *self, PyObject *args, PyObject *kw)
 				     &PyType_Type, &reply))
 	return NULL;
 
-    if (!request->is_void)
-	if (reply == NULL || !PyType_IsSubtype(reply, &xpybReply_type)) {
-	    PyErr_SetString(xpybExcept_base, "Reply type missing or not derived from xcb.Reply.");
-	    return NULL;
-	}
-
-    /* Check the connection */
-    if (xpybConn_invalid(self->conn))
-	return NULL;
-
-    /* Set up request structure */
-    xcb_req.count = 2;
-    xcb_req.ext = (self->key != (xpybExtkey *)Py_None) ? &self->key->key : 0;
-    xcb_req.opcode = request->opcode;
-    xcb_req.isvoid = request->is_void;
-
-    /* Allocate and fill in data strings */
-    if (PyObject_AsReadBuffer(((xpybProtobj *)request)->buf, &data, &size) < 0)
-	return NULL;
-    xcb_parts[2].iov_base = (void *)data;
-    xcb_parts[2].iov_len = size;
-    xcb_parts[3].iov_base = 0;
-    xcb_parts[3].iov_len = -xcb_parts[2].iov_len & 3;
-
-    /* Make request call */
-    flags = request->is_checked ? XCB_REQUEST_CHECKED : 0;
-    seq = xcb_send_request(self->conn->conn, flags, xcb_parts + 2, &xcb_req);
+    return xpybExt_send(self, request, cookie, reply);
+}
 
-    /* Set up cookie */
-    Py_INCREF(cookie->conn = self->conn);
-    Py_INCREF((PyObject *)(cookie->request = request));
-    Py_XINCREF(cookie->reply_type = reply);
-    cookie->cookie.sequence = seq;
+static PyObject *
+xpybExt_begin_request(xpybExt *self, PyObject *args)
+{
+    if (self->conn->priv->phase_timing)
+	self->conn->priv->phase_mark = xpybModule_now();
 
-    Py_INCREF(cookie);
-    return (PyObject *)cookie;
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef xpybExt_methods[] = {
+    { "begin_request",
+      (PyCFunction)xpybExt_begin_request,
+      METH_NOARGS,
+      "Marks the start of encoding a request, for phase timing." },
+
     { "send_request",
       (PyCFunction)xpybExt_send_request,
       METH_VARARGS | METH_KEYWORDS,
@@ -166,9 +242,10 @@ PyTypeObject xpybExt_type = {
     .tp_init = (initproc)xpybExt_init,
     .tp_new = xpybExt_new,
     .tp_dealloc = (destructor)xpybExt_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB extension object",
     .tp_members = xpybExt_members,
+    .tp_getset = xpybExt_getset,
     .tp_methods = xpybExt_methods
 };
 
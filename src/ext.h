@@ -3,6 +3,8 @@
 
 #include "conn.h"
 #include "extkey.h"
+#include "cookie.h"
+#include "request.h"
 
 typedef struct {
     PyObject_HEAD
@@ -16,6 +18,8 @@ typedef struct {
 
 extern PyTypeObject xpybExt_type;
 
+PyObject *xpybExt_send(xpybExt *self, xpybRequest *request, xpybCookie *cookie, PyTypeObject *reply);
+
 int xpybExt_modinit(PyObject *m);
 
 #endif
@@ -55,7 +55,7 @@ PyTypeObject xpybExtkey_type = {
     .tp_init = (initproc)xpybExtkey_init,
     .tp_new = xpybExtkey_new,
     .tp_dealloc = (destructor)xpybExtkey_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG,
     .tp_doc = "XCB extension-key object",
     .tp_hash = (hashfunc)xpybExtkey_hash
 };
@@ -0,0 +1,167 @@
+#include "module.h"
+#include "except.h"
+#include "freelist.h"
+#include "memstat.h"
+
+/*
+ * Freelists of object memory, in the style of the ones CPython keeps for
+ * tuples and frames.  Objects handed out by a freelist are laid out
+ * exactly as PyType_GenericAlloc would lay them out, so they are later
+ * released through the type's usual tp_free if they do not fit back in
+ * the list.  This also covers instances of the generated subclasses,
+ * which are garbage collected and carry a GC header in front.
+ */
+
+typedef struct xpybFreeblock {
+    struct xpybFreeblock *next;
+    size_t size;
+} xpybFreeblock;
+
+xpybFreelist xpybFreelist_cookie = { "cookie", NULL, 0, 256, 0, 0 };
+xpybFreelist xpybFreelist_protobj = { "protobj", NULL, 0, 256, 0, 0 };
+xpybFreelist xpybFreelist_rawbuf = { "rawbuf", NULL, 0, 256, 0, 0 };
+
+static xpybFreelist *xpybFreelist_all[] = {
+    &xpybFreelist_cookie,
+    &xpybFreelist_protobj,
+    &xpybFreelist_rawbuf,
+    NULL
+};
+
+/*
+ * Helpers
+ */
+
+static int
+xpybFreelist_usable(PyTypeObject *type)
+{
+    return type->tp_itemsize == 0 &&
+	(type->tp_free == PyObject_Del || type->tp_free == PyObject_GC_Del);
+}
+
+static void
+xpybFreelist_trim(xpybFreelist *list)
+{
+    xpybFreeblock *b;
+
+    while (list->len > list->max) {
+	b = list->head;
+	list->head = b->next;
+	list->len--;
+	PyObject_Free(b);
+    }
+}
+
+PyObject *
+xpybFreelist_new(xpybFreelist *list, PyTypeObject *type)
+{
+    size_t gc = PyType_IS_GC(type) ? sizeof(PyGC_Head) : 0;
+    size_t size = type->tp_basicsize + gc;
+    xpybFreeblock *b = list->head;
+    PyObject *obj;
+
+    if (b == NULL || type->tp_alloc != PyType_GenericAlloc || !xpybFreelist_usable(type)) {
+	list->misses++;
+	goto alloc;
+    }
+
+    list->head = b->next;
+    list->len--;
+    if (b->size < size) {
+	PyObject_Free(b);
+	list->misses++;
+	goto alloc;
+    }
+    list->hits++;
+
+    /* Same steps as PyType_GenericAlloc, minus the allocation. */
+    memset(b, 0, size);
+    obj = (PyObject *)((char *)b + gc);
+    if (gc)
+	_Py_AS_GC(obj)->gc.gc_refs = _PyGC_REFS_UNTRACKED;
+    if (type->tp_flags & Py_TPFLAGS_HEAPTYPE)
+	Py_INCREF(type);
+    (void)PyObject_INIT(obj, type);
+    if (gc)
+	_PyObject_GC_TRACK(obj);
+
+    if (xpybMemstat_enabled)
+	xpybMemstat_alloc(obj);
+    return obj;
+
+alloc:
+    obj = type->tp_alloc(type, 0);
+    if (obj != NULL && xpybMemstat_enabled)
+	xpybMemstat_alloc(obj);
+    return obj;
+}
+
+/*
+ * Called in place of tp_free at the end of tp_dealloc.
+ */
+void
+xpybFreelist_free(xpybFreelist *list, PyObject *obj)
+{
+    PyTypeObject *type = obj->ob_type;
+    size_t gc = PyType_IS_GC(type) ? sizeof(PyGC_Head) : 0;
+    xpybFreeblock *b;
+
+    if (xpybMemstat_enabled)
+	xpybMemstat_free(obj);
+    if (list->len >= list->max || !xpybFreelist_usable(type)) {
+	type->tp_free(obj);
+	return;
+    }
+
+    b = (xpybFreeblock *)((char *)obj - gc);
+    b->size = type->tp_basicsize + gc;
+    b->next = list->head;
+    list->head = b;
+    list->len++;
+}
+
+PyObject *
+xpybFreelist_stats(void)
+{
+    xpybFreelist **list;
+    PyObject *result, *item;
+
+    result = PyDict_New();
+    if (result == NULL)
+	return NULL;
+
+    for (list = xpybFreelist_all; *list; list++) {
+	item = Py_BuildValue("{s:i,s:i,s:k,s:k}", "length", (*list)->len,
+			     "max", (*list)->max, "hits", (*list)->hits,
+			     "misses", (*list)->misses);
+	if (item == NULL || PyDict_SetItemString(result, (*list)->name, item) < 0) {
+	    Py_XDECREF(item);
+	    Py_DECREF(result);
+	    return NULL;
+	}
+	Py_DECREF(item);
+    }
+
+    return result;
+}
+
+int
+xpybFreelist_set_max(const char *name, int max)
+{
+    xpybFreelist **list;
+
+    if (max < 0) {
+	PyErr_SetString(PyExc_ValueError, "Freelist size must not be negative.");
+	return -1;
+    }
+
+    for (list = xpybFreelist_all; *list; list++)
+	if (strcmp((*list)->name, name) == 0) {
+	    (*list)->max = max;
+	    xpybFreelist_trim(*list);
+	    return 0;
+	}
+
+    PyErr_Format(xpybExcept_base, "No freelist named '%s'.", name);
+    return -1;
+}
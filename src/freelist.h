@@ -0,0 +1,23 @@
+#ifndef XPYB_FREELIST_H
+#define XPYB_FREELIST_H
+
+typedef struct {
+    const char *name;
+    void *head;
+    int len;
+    int max;
+    unsigned long hits;
+    unsigned long misses;
+} xpybFreelist;
+
+extern xpybFreelist xpybFreelist_cookie;
+extern xpybFreelist xpybFreelist_protobj;
+extern xpybFreelist xpybFreelist_rawbuf;
+
+PyObject *xpybFreelist_new(xpybFreelist *list, PyTypeObject *type);
+void xpybFreelist_free(xpybFreelist *list, PyObject *obj);
+
+PyObject *xpybFreelist_stats(void);
+int xpybFreelist_set_max(const char *name, int max);
+
+#endif
@@ -159,7 +159,7 @@ PyTypeObject xpybIter_type = {
     .tp_init = (initproc)xpybIter_init,
     .tp_new = xpybIter_new,
     .tp_dealloc = (destructor)xpybIter_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG,
     .tp_doc = "XCB flattening-iterator object",
     .tp_iter = (getiterfunc)xpybIter_get,
     .tp_iternext = (iternextfunc)xpybIter_next
@@ -0,0 +1,203 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "lag.h"
+
+/*
+ * Event lag.  libxcb does not say when an event came off the socket, so
+ * the age of an event is taken from its server timestamp: the smallest
+ * difference seen between client time and server time is the fastest
+ * delivery, and anything above it was spent queued somewhere on the way
+ * to Python.  Handler time runs from handing an event to Python until the
+ * next wait_for_event() or poll_for_event() call.  The last samples of
+ * each are kept per event type for percentiles.
+ */
+
+/* Core events carrying a timestamp, by opcode: offset of the field */
+static const unsigned char xpybLag_time_offset[32] = {
+    [XCB_KEY_PRESS] = 4,
+    [XCB_KEY_RELEASE] = 4,
+    [XCB_BUTTON_PRESS] = 4,
+    [XCB_BUTTON_RELEASE] = 4,
+    [XCB_MOTION_NOTIFY] = 4,
+    [XCB_ENTER_NOTIFY] = 4,
+    [XCB_LEAVE_NOTIFY] = 4,
+    [XCB_PROPERTY_NOTIFY] = 12,
+    [XCB_SELECTION_CLEAR] = 4,
+    [XCB_SELECTION_REQUEST] = 4,
+    [XCB_SELECTION_NOTIFY] = 4,
+};
+
+/*
+ * Helpers
+ */
+
+static int
+xpybLag_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Returns None when there are no samples yet */
+static PyObject *
+xpybLag_percentiles(double *ring, unsigned long total, int samples)
+{
+    double *sorted;
+    PyObject *result;
+    int n = total < samples ? total : samples;
+
+    if (n == 0)
+	Py_RETURN_NONE;
+
+    sorted = malloc(n * sizeof(*sorted));
+    if (sorted == NULL)
+	return PyErr_NoMemory();
+    memcpy(sorted, ring, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), xpybLag_compare);
+
+    result = Py_BuildValue("{sdsdsdsd}",
+			   "p50", sorted[(n - 1) * 50 / 100],
+			   "p90", sorted[(n - 1) * 90 / 100],
+			   "p99", sorted[(n - 1) * 99 / 100],
+			   "max", sorted[n - 1]);
+    free(sorted);
+    return result;
+}
+
+static int
+xpybLag_alloc(xpybLagEntry *entry, int samples)
+{
+    entry->ages = malloc(samples * sizeof(double));
+    entry->handlers = malloc(samples * sizeof(double));
+    if (entry->ages == NULL || entry->handlers == NULL) {
+	free(entry->ages);
+	free(entry->handlers);
+	entry->ages = entry->handlers = NULL;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Called for every event handed to Python.  Synthetic events are counted
+ * but not aged, since their timestamps come from another client.
+ */
+void
+xpybLag_event(xpybConn *conn, xcb_generic_event_t *e)
+{
+    unsigned char opcode = e->response_type & 0x7f;
+    xpybLagEntry *entry = conn->priv->lag + opcode;
+    unsigned int server, delta;
+    double now = xpybModule_now();
+
+    if (entry->ages == NULL && xpybLag_alloc(entry, conn->priv->lag_samples) < 0)
+	return;
+
+    entry->count++;
+    conn->priv->lag_last_type = opcode;
+    conn->priv->lag_last_time = now;
+
+    if (opcode >= 32 || xpybLag_time_offset[opcode] == 0 || (e->response_type & 0x80))
+	return;
+
+    /* Server time is in milliseconds and wraps at 32 bits */
+    memcpy(&server, (char *)e + xpybLag_time_offset[opcode], sizeof(server));
+    delta = (unsigned int)(unsigned long long)(now * 1000) - server;
+    if (!conn->priv->lag_synced || (int)(delta - conn->priv->lag_offset) < 0) {
+	conn->priv->lag_offset = delta;
+	conn->priv->lag_synced = 1;
+    }
+
+    entry->ages[entry->aged++ % conn->priv->lag_samples] = (delta - conn->priv->lag_offset) / 1000.0;
+}
+
+/* Called on entry to wait_for_event() and poll_for_event() */
+void
+xpybLag_handled(xpybConn *conn)
+{
+    xpybLagEntry *entry;
+
+    if (conn->priv->lag_last_type < 0)
+	return;
+
+    entry = conn->priv->lag + conn->priv->lag_last_type;
+    entry->handlers[entry->handled++ % conn->priv->lag_samples] = xpybModule_now() - conn->priv->lag_last_time;
+    conn->priv->lag_last_type = -1;
+}
+
+/*
+ * Enabling starts from zero with room for the given number of samples
+ * per event type; zero samples turns tracking off.
+ */
+int
+xpybLag_enable(xpybConn *conn, int samples)
+{
+    xpybLag_clear(conn);
+    if (samples == 0)
+	return 0;
+
+    conn->priv->lag = calloc(128, sizeof(xpybLagEntry));
+    if (conn->priv->lag == NULL) {
+	PyErr_NoMemory();
+	return -1;
+    }
+    conn->priv->lag_samples = samples;
+    return 0;
+}
+
+void
+xpybLag_clear(xpybConn *conn)
+{
+    int i;
+
+    if (conn->priv->lag != NULL)
+	for (i = 0; i < 128; i++) {
+	    free(conn->priv->lag[i].ages);
+	    free(conn->priv->lag[i].handlers);
+	}
+    free(conn->priv->lag);
+    conn->priv->lag = NULL;
+    conn->priv->lag_samples = 0;
+    conn->priv->lag_synced = 0;
+    conn->priv->lag_offset = 0;
+    conn->priv->lag_last_type = -1;
+}
+
+PyObject *
+xpybLag_report(xpybConn *conn)
+{
+    PyObject *result, *value, *key, *ages, *handlers;
+    xpybLagEntry *entry;
+    int i;
+
+    result = PyDict_New();
+    if (result == NULL || conn->priv->lag == NULL)
+	return result;
+
+    for (i = 0; i < 128; i++) {
+	entry = conn->priv->lag + i;
+	if (entry->count == 0)
+	    continue;
+
+	ages = xpybLag_percentiles(entry->ages, entry->aged, conn->priv->lag_samples);
+	handlers = xpybLag_percentiles(entry->handlers, entry->handled, conn->priv->lag_samples);
+	value = (ages && handlers) ? Py_BuildValue("{sksOsO}", "count", entry->count,
+						   "age", ages, "handler", handlers) : NULL;
+	Py_XDECREF(ages);
+	Py_XDECREF(handlers);
+
+	key = PyInt_FromLong(i);
+	if (value == NULL || key == NULL || PyDict_SetItem(result, key, value) < 0) {
+	    Py_XDECREF(key);
+	    Py_XDECREF(value);
+	    Py_DECREF(result);
+	    return NULL;
+	}
+	Py_DECREF(key);
+	Py_DECREF(value);
+    }
+
+    return result;
+}
@@ -0,0 +1,13 @@
+#ifndef XPYB_LAG_H
+#define XPYB_LAG_H
+
+#include "conn.h"
+
+void xpybLag_event(xpybConn *conn, xcb_generic_event_t *e);
+void xpybLag_handled(xpybConn *conn);
+
+int xpybLag_enable(xpybConn *conn, int samples);
+void xpybLag_clear(xpybConn *conn);
+PyObject *xpybLag_report(xpybConn *conn);
+
+#endif
@@ -0,0 +1,160 @@
+#include "module.h"
+#include "except.h"
+#include "lazymod.h"
+
+/*
+ * A module whose generated classes are created on first access.  The
+ * generated code registers a factory per class in the module's _lazy
+ * dictionary; looking up a missing name runs the factory and stores the
+ * result in the module dictionary, where later lookups find it directly.
+ *
+ * The lazy module shares its dictionary with the module object that the
+ * import machinery created, which therefore has to be kept alive: a module
+ * clears its dictionary when it is deallocated.
+ */
+
+static PyObject *xpybLazymod_origins;
+
+/*
+ * Helpers
+ */
+
+static PyObject *
+xpybLazymod_all(PyObject *dict, PyObject *table)
+{
+    PyObject *result, *key, *value;
+    Py_ssize_t i = 0;
+
+    result = PyList_New(0);
+    if (result == NULL)
+	return NULL;
+
+    while (PyDict_Next(dict, &i, &key, &value))
+	if (PyString_Check(key) && PyString_AS_STRING(key)[0] != '_')
+	    if (PyList_Append(result, key) < 0)
+		goto err;
+
+    i = 0;
+    while (table && PyDict_Next(table, &i, &key, &value))
+	if (PyList_Append(result, key) < 0)
+	    goto err;
+
+    if (PyList_Sort(result) < 0)
+	goto err;
+
+    return result;
+err:
+    Py_DECREF(result);
+    return NULL;
+}
+
+PyObject *
+xpybLazymod_install(const char *name)
+{
+    PyObject *modules, *orig, *self, **dictptr;
+
+    modules = PyImport_GetModuleDict();
+    orig = PyDict_GetItemString(modules, name);
+    if (orig == NULL || !PyModule_Check(orig)) {
+	PyErr_Format(xpybExcept_base, "No module named '%s' is being imported.", name);
+	return NULL;
+    }
+    if (PyObject_TypeCheck(orig, &xpybLazymod_type)) {
+	Py_INCREF(orig);
+	return orig;
+    }
+
+    self = PyType_GenericAlloc(&xpybLazymod_type, 0);
+    if (self == NULL)
+	return NULL;
+
+    dictptr = _PyObject_GetDictPtr(self);
+    Py_INCREF(*dictptr = PyModule_GetDict(orig));
+
+    if (PyList_Append(xpybLazymod_origins, orig) < 0)
+	goto err;
+    if (PyDict_SetItemString(modules, name, self) < 0)
+	goto err;
+
+    return self;
+err:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+/*
+ * Infrastructure
+ */
+
+static PyObject *
+xpybLazymod_getattro(PyObject *self, PyObject *name)
+{
+    PyObject *result, *dict, *table, *factory;
+
+    result = PyObject_GenericGetAttr(self, name);
+    if (result != NULL || !PyErr_ExceptionMatches(PyExc_AttributeError))
+	return result;
+
+    dict = *_PyObject_GetDictPtr(self);
+    table = dict ? PyDict_GetItemString(dict, "_lazy") : NULL;
+    if (table != NULL && !PyDict_Check(table))
+	table = NULL;
+
+    factory = table ? PyDict_GetItem(table, name) : NULL;
+    if (factory == NULL) {
+	if (dict && strcmp(PyString_AS_STRING(name), "__all__") == 0) {
+	    PyErr_Clear();
+	    return xpybLazymod_all(dict, table);
+	}
+	return NULL;
+    }
+    PyErr_Clear();
+
+    /* Taken out first, so that a failing factory is not retried forever */
+    Py_INCREF(factory);
+    if (PyDict_DelItem(table, name) < 0)
+	goto out;
+
+    result = PyObject_CallObject(factory, NULL);
+    if (result != NULL && PyDict_SetItem(dict, name, result) < 0)
+	Py_CLEAR(result);
+out:
+    Py_DECREF(factory);
+    return result;
+}
+
+
+/*
+ * Definition
+ */
+
+PyTypeObject xpybLazymod_type = {
+    PyObject_HEAD_INIT(NULL)
+    .tp_name = "xcb.LazyModule",
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG,
+    .tp_doc = "Module whose generated classes are created on first use",
+    .tp_base = &PyModule_Type,
+    .tp_getattro = xpybLazymod_getattro
+};
+
+
+/*
+ * Module init
+ */
+int xpybLazymod_modinit(PyObject *m)
+{
+    /* The module struct is private; borrow its size. */
+    xpybLazymod_type.tp_basicsize = PyModule_Type.tp_basicsize;
+
+    if ((xpybLazymod_origins = PyList_New(0)) == NULL)
+	return -1;
+
+    if (PyType_Ready(&xpybLazymod_type) < 0)
+        return -1;
+    Py_INCREF(&xpybLazymod_type);
+    if (PyModule_AddObject(m, "LazyModule", (PyObject *)&xpybLazymod_type) < 0)
+	return -1;
+
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef XPYB_LAZYMOD_H
+#define XPYB_LAZYMOD_H
+
+extern PyTypeObject xpybLazymod_type;
+
+PyObject *xpybLazymod_install(const char *name);
+
+int xpybLazymod_modinit(PyObject *m);
+
+#endif
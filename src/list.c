@@ -1,6 +1,7 @@
 #include "module.h"
 #include "except.h"
 #include "list.h"
+#include "memstat.h"
 
 /*
  * Helpers
@@ -37,6 +38,43 @@ xpybList_build(PyObject *str, Py_ssize_t size, const char *data)
     return NULL;
 }
 
+/*
+ * Lists of fixed-size structures only decode an element when it is first
+ * accessed; until then its slot in the underlying list is empty.
+ */
+static PyObject *
+xpybList_get(xpybList *self, Py_ssize_t i)
+{
+    PyObject *obj = PyList_GET_ITEM(self->list, i);
+
+    if (obj == NULL) {
+	obj = PyObject_CallFunction(self->type, "Onn", self->parent,
+				    self->offset + i * self->size, self->size);
+	if (obj == NULL)
+	    return NULL;
+	PyList_SET_ITEM(self->list, i, obj);
+    }
+
+    return obj;
+}
+
+static int
+xpybList_fill(xpybList *self)
+{
+    Py_ssize_t i;
+
+    if (self->type == NULL)
+	return 0;
+
+    for (i = 0; i < PyList_GET_SIZE(self->list); i++)
+	if (xpybList_get(self, i) == NULL)
+	    return -1;
+
+    Py_CLEAR(self->parent);
+    Py_CLEAR(self->type);
+    return 0;
+}
+
 
 /*
  * Infrastructure
@@ -45,7 +83,11 @@ xpybList_build(PyObject *str, Py_ssize_t size, const char *data)
 static PyObject *
 xpybList_new(PyTypeObject *self, PyObject *args, PyObject *kw)
 {
-    return PyType_GenericNew(self, args, kw);
+    PyObject *obj = PyType_GenericNew(self, args, kw);
+
+    if (obj != NULL && xpybMemstat_enabled)
+	xpybMemstat_alloc(obj);
+    return obj;
 }
 
 static int
@@ -60,10 +102,6 @@ xpybList_init(xpybList *self, PyObject *args, PyObject *kw)
 				     &offset, &length, &type, &size))
 	return -1;
 
-    self->list = PyList_New(0);
-    if (self->list == NULL)
-	return -1;
-
     if (PyObject_AsReadBuffer(parent, (const void **)&data, &datalen) < 0)
 	return -1;
     if (size > 0 && length * size + offset > datalen) {
@@ -74,6 +112,22 @@ xpybList_init(xpybList *self, PyObject *args, PyObject *kw)
 
     cur = offset;
 
+    if (size > 0 && !PyString_CheckExact(type)) {
+	self->list = PyList_New(length);
+	if (self->list == NULL)
+	    return -1;
+	Py_INCREF(self->parent = parent);
+	Py_INCREF(self->type = type);
+	self->offset = offset;
+	self->size = size;
+	cur += length * size;
+	goto out;
+    }
+
+    self->list = PyList_New(0);
+    if (self->list == NULL)
+	return -1;
+
     for (i = 0; i < length; i++) {
 	if (PyString_CheckExact(type)) {
 	    obj = xpybList_build(type, length, data + cur);
@@ -104,6 +158,7 @@ xpybList_init(xpybList *self, PyObject *args, PyObject *kw)
         Py_DECREF(obj);
     }
 
+out:
     self->buf = PyBuffer_FromObject(parent, offset, cur - offset);
     if (self->buf == NULL)
 	return -1;
@@ -116,6 +171,10 @@ xpybList_dealloc(xpybList *self)
 {
     Py_CLEAR(self->list);
     Py_CLEAR(self->buf);
+    Py_CLEAR(self->parent);
+    Py_CLEAR(self->type);
+    if (xpybMemstat_enabled)
+	xpybMemstat_free((PyObject *)self);
     xpybList_type.tp_base->tp_dealloc((PyObject *)self);
 }
 
@@ -128,54 +187,77 @@ xpybList_length(xpybList *self)
 static PyObject *
 xpybList_concat(xpybList *self, PyObject *arg)
 {
+    if (xpybList_fill(self) < 0)
+	return NULL;
     return PyList_Type.tp_as_sequence->sq_concat(self->list, arg);
 }
 
 static PyObject *
 xpybList_repeat(xpybList *self, Py_ssize_t arg)
 {
+    if (xpybList_fill(self) < 0)
+	return NULL;
     return PyList_Type.tp_as_sequence->sq_repeat(self->list, arg);
 }
 
 static PyObject *
 xpybList_item(xpybList *self, Py_ssize_t arg)
 {
-    return PyList_Type.tp_as_sequence->sq_item(self->list, arg);
+    PyObject *obj;
+
+    if (self->type == NULL || arg < 0 || arg >= PyList_GET_SIZE(self->list))
+	return PyList_Type.tp_as_sequence->sq_item(self->list, arg);
+
+    obj = xpybList_get(self, arg);
+    Py_XINCREF(obj);
+    return obj;
 }
 
 static PyObject *
 xpybList_slice(xpybList *self, Py_ssize_t arg1, Py_ssize_t arg2)
 {
+    if (xpybList_fill(self) < 0)
+	return NULL;
     return PyList_Type.tp_as_sequence->sq_slice(self->list, arg1, arg2);
 }
 
 static int
 xpybList_ass_item(xpybList *self, Py_ssize_t arg1, PyObject *arg2)
 {
+    if (xpybList_fill(self) < 0)
+	return -1;
     return PyList_Type.tp_as_sequence->sq_ass_item(self->list, arg1, arg2);
 }
 
 static int
 xpybList_ass_slice(xpybList *self, Py_ssize_t arg1, Py_ssize_t arg2, PyObject *arg3)
 {
+    if (xpybList_fill(self) < 0)
+	return -1;
     return PyList_Type.tp_as_sequence->sq_ass_slice(self->list, arg1, arg2, arg3);
 }
 
 static int
 xpybList_contains(xpybList *self, PyObject *arg)
 {
+    if (xpybList_fill(self) < 0)
+	return -1;
     return PyList_Type.tp_as_sequence->sq_contains(self->list, arg);
 }
 
 static PyObject *
 xpybList_inplace_concat(xpybList *self, PyObject *arg)
 {
+    if (xpybList_fill(self) < 0)
+	return NULL;
     return PyList_Type.tp_as_sequence->sq_inplace_concat(self->list, arg);
 }
 
 static PyObject *
 xpybList_inplace_repeat(xpybList *self, Py_ssize_t arg)
 {
+    if (xpybList_fill(self) < 0)
+	return NULL;
     return PyList_Type.tp_as_sequence->sq_inplace_repeat(self->list, arg);
 }
 
@@ -230,7 +312,7 @@ PyTypeObject xpybList_type = {
     .tp_new = xpybList_new,
     .tp_init = (initproc)xpybList_init,
     .tp_dealloc = (destructor)xpybList_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic list object",
     .tp_methods = xpybList_methods,
     .tp_as_sequence = &xpybList_seqops
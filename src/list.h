@@ -7,6 +7,10 @@ typedef struct {
     PyObject_HEAD
     PyObject *buf;
     PyObject *list;
+    PyObject *parent;
+    PyObject *type;
+    Py_ssize_t offset;
+    Py_ssize_t size;
 } xpybList;
 
 extern PyTypeObject xpybList_type;
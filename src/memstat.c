@@ -0,0 +1,263 @@
+#include "module.h"
+#include "except.h"
+#include "memstat.h"
+#include "cookie.h"
+#include "reply.h"
+#include "event.h"
+#include "error.h"
+#include "request.h"
+#include "list.h"
+#include "struct.h"
+#include "union.h"
+#include "rawbuf.h"
+
+/*
+ * Live memory accounting.  Objects are counted per exact type as they are
+ * created and freed, in a small open-addressing table keyed by the type
+ * pointer, and only sorted into categories when a report is asked for.
+ * Buffer memory and request payloads held by cookies are summed apart,
+ * since their sizes vary per object.  Nothing is counted until it is
+ * switched on, and callers test xpybMemstat_enabled before each call so
+ * that the allocation paths pay nothing otherwise.  Objects that were
+ * alive before that are not counted; decrements for them stop at zero.
+ */
+
+typedef struct {
+    PyTypeObject *type;
+    Py_ssize_t count;
+} xpybMemstatSlot;
+
+static xpybMemstatSlot *xpybMemstat_table;
+static Py_ssize_t xpybMemstat_size;
+static Py_ssize_t xpybMemstat_used;
+
+int xpybMemstat_enabled;
+
+static Py_ssize_t xpybMemstat_buffer_bytes;
+static Py_ssize_t xpybMemstat_pinned;
+static Py_ssize_t xpybMemstat_pinned_bytes;
+
+/* Report categories, checked in order; the first base type matching wins */
+static const struct {
+    const char *name;
+    PyTypeObject *type;
+} xpybMemstat_categories[] = {
+    { "cookies", &xpybCookie_type },
+    { "replies", &xpybReply_type },
+    { "events", &xpybEvent_type },
+    { "errors", &xpybError_type },
+    { "requests", &xpybRequest_type },
+    { "lists", &xpybList_type },
+    { "structs", &xpybStruct_type },
+    { "unions", &xpybUnion_type },
+    { "buffers", &xpybRawbuf_type },
+    { NULL }
+};
+
+/*
+ * Helpers
+ */
+
+static xpybMemstatSlot *
+xpybMemstat_find(xpybMemstatSlot *table, Py_ssize_t size, PyTypeObject *type)
+{
+    Py_ssize_t i = ((size_t)type >> 4) & (size - 1);
+
+    while (table[i].type != NULL && table[i].type != type)
+	i = (i + 1) & (size - 1);
+    return table + i;
+}
+
+/* Keeps the table at most half full; failing to grow only loses counts */
+static int
+xpybMemstat_grow(void)
+{
+    xpybMemstatSlot *table, *slot;
+    Py_ssize_t i, size = xpybMemstat_size ? xpybMemstat_size * 2 : 64;
+
+    table = calloc(size, sizeof(*table));
+    if (table == NULL)
+	return -1;
+
+    for (i = 0; i < xpybMemstat_size; i++)
+	if (xpybMemstat_table[i].type != NULL) {
+	    slot = xpybMemstat_find(table, size, xpybMemstat_table[i].type);
+	    *slot = xpybMemstat_table[i];
+	}
+
+    free(xpybMemstat_table);
+    xpybMemstat_table = table;
+    xpybMemstat_size = size;
+    return 0;
+}
+
+static Py_ssize_t
+xpybMemstat_object_size(PyTypeObject *type)
+{
+    return type->tp_basicsize + (PyType_IS_GC(type) ? sizeof(PyGC_Head) : 0);
+}
+
+/* Turning counting off drops the counts, so that it restarts from zero */
+void
+xpybMemstat_enable(int enabled)
+{
+    Py_ssize_t i;
+
+    xpybMemstat_enabled = enabled;
+    if (enabled)
+	return;
+
+    for (i = 0; i < xpybMemstat_size; i++)
+	Py_XDECREF(xpybMemstat_table[i].type);
+    free(xpybMemstat_table);
+    xpybMemstat_table = NULL;
+    xpybMemstat_size = 0;
+    xpybMemstat_used = 0;
+    xpybMemstat_buffer_bytes = 0;
+    xpybMemstat_pinned = 0;
+    xpybMemstat_pinned_bytes = 0;
+}
+
+/*
+ * Called for every object handed out by a freelist, and for lists.  A
+ * heap type stays referenced by its slot, so that its address cannot be
+ * reused by another type.
+ */
+void
+xpybMemstat_alloc(PyObject *obj)
+{
+    PyTypeObject *type = obj->ob_type;
+    xpybMemstatSlot *slot;
+
+    if (xpybMemstat_used * 2 >= xpybMemstat_size && xpybMemstat_grow() < 0)
+	return;
+
+    slot = xpybMemstat_find(xpybMemstat_table, xpybMemstat_size, type);
+    if (slot->type == NULL) {
+	Py_INCREF(slot->type = type);
+	xpybMemstat_used++;
+    }
+    slot->count++;
+}
+
+void
+xpybMemstat_free(PyObject *obj)
+{
+    xpybMemstatSlot *slot;
+
+    if (xpybMemstat_table == NULL)
+	return;
+
+    slot = xpybMemstat_find(xpybMemstat_table, xpybMemstat_size, obj->ob_type);
+    if (slot->type != NULL && slot->count > 0)
+	slot->count--;
+}
+
+/* Called with the data size of each buffer, negated when it is freed */
+void
+xpybMemstat_buffer(Py_ssize_t size)
+{
+    xpybMemstat_buffer_bytes += size;
+    if (xpybMemstat_buffer_bytes < 0)
+	xpybMemstat_buffer_bytes = 0;
+}
+
+void
+xpybMemstat_pin(Py_ssize_t size, int sign)
+{
+    xpybMemstat_pinned += sign;
+    xpybMemstat_pinned_bytes += sign * size;
+    if (xpybMemstat_pinned <= 0)
+	xpybMemstat_pinned = xpybMemstat_pinned_bytes = 0;
+}
+
+static int
+xpybMemstat_add(PyObject *category, PyObject *type, Py_ssize_t count, Py_ssize_t bytes)
+{
+    PyObject *types, *value;
+    Py_ssize_t total;
+
+    total = PyInt_AsSsize_t(PyDict_GetItemString(category, "count")) + count;
+    value = PyInt_FromSsize_t(total);
+    if (value == NULL || PyDict_SetItemString(category, "count", value) < 0)
+	goto err;
+    Py_DECREF(value);
+
+    total = PyInt_AsSsize_t(PyDict_GetItemString(category, "bytes")) + bytes;
+    value = PyInt_FromSsize_t(total);
+    if (value == NULL || PyDict_SetItemString(category, "bytes", value) < 0)
+	goto err;
+    Py_DECREF(value);
+
+    types = PyDict_GetItemString(category, "types");
+    value = Py_BuildValue("{snsn}", "count", count, "bytes", bytes);
+    if (value == NULL || PyDict_SetItem(types, type, value) < 0)
+	goto err;
+    Py_DECREF(value);
+    return 0;
+err:
+    Py_XDECREF(value);
+    return -1;
+}
+
+/*
+ * Returns live counts and bytes by category and type.  Object bytes are
+ * instance sizes; the 'buffers' category adds the data the buffers hold,
+ * and 'pinned' counts request payloads still referenced by cookies.
+ */
+PyObject *
+xpybMemstat_report(void)
+{
+    PyObject *result, *category, *value = NULL;
+    xpybMemstatSlot *slot;
+    Py_ssize_t i, bytes;
+    int c;
+
+    result = PyDict_New();
+    if (result == NULL)
+	return NULL;
+
+    for (c = 0; xpybMemstat_categories[c].name; c++) {
+	category = Py_BuildValue("{sisis{}}", "count", 0, "bytes", 0, "types");
+	if (category == NULL ||
+	    PyDict_SetItemString(result, xpybMemstat_categories[c].name, category) < 0) {
+	    Py_XDECREF(category);
+	    goto err;
+	}
+	Py_DECREF(category);
+    }
+
+    for (i = 0; i < xpybMemstat_size; i++) {
+	slot = xpybMemstat_table + i;
+	if (slot->type == NULL || slot->count == 0)
+	    continue;
+
+	for (c = 0; xpybMemstat_categories[c].name; c++)
+	    if (PyType_IsSubtype(slot->type, xpybMemstat_categories[c].type))
+		break;
+	if (xpybMemstat_categories[c].name == NULL)
+	    continue;
+
+	bytes = slot->count * xpybMemstat_object_size(slot->type);
+	if (xpybMemstat_add(PyDict_GetItemString(result, xpybMemstat_categories[c].name),
+			    (PyObject *)slot->type, slot->count, bytes) < 0)
+	    goto err;
+    }
+
+    category = PyDict_GetItemString(result, "buffers");
+    value = PyInt_FromSsize_t(xpybMemstat_buffer_bytes);
+    if (value == NULL || PyDict_SetItemString(category, "data", value) < 0)
+	goto err;
+    Py_DECREF(value);
+
+    value = Py_BuildValue("{snsn}", "count", xpybMemstat_pinned, "bytes", xpybMemstat_pinned_bytes);
+    if (value == NULL || PyDict_SetItemString(result, "pinned", value) < 0)
+	goto err;
+    Py_DECREF(value);
+
+    return result;
+err:
+    Py_XDECREF(value);
+    Py_DECREF(result);
+    return NULL;
+}
@@ -0,0 +1,14 @@
+#ifndef XPYB_MEMSTAT_H
+#define XPYB_MEMSTAT_H
+
+extern int xpybMemstat_enabled;
+
+void xpybMemstat_enable(int enabled);
+void xpybMemstat_alloc(PyObject *obj);
+void xpybMemstat_free(PyObject *obj);
+void xpybMemstat_buffer(Py_ssize_t size);
+void xpybMemstat_pin(Py_ssize_t size, int sign);
+
+PyObject *xpybMemstat_report(void);
+
+#endif
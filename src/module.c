@@ -4,6 +4,10 @@
 #include "constant.h"
 #include "cookie.h"
 #include "protobj.h"
+#include "rawbuf.h"
+#include "freelist.h"
+#include "memstat.h"
+#include "capi.h"
 #include "response.h"
 #include "event.h"
 #include "error.h"
@@ -17,6 +21,14 @@
 #include "extkey.h"
 #include "ext.h"
 #include "void.h"
+#include "lazymod.h"
+#include "setupidx.h"
+#include "mux.h"
+#include "ring.h"
+#include "replay.h"
+#include "probes.h"
+
+#include <time.h>
 
 
 /*
@@ -32,6 +44,32 @@ PyObject *xpybModule_extdict;
 PyObject *xpybModule_ext_events;
 PyObject *xpybModule_ext_errors;
 
+#if defined(XPYB_ENABLE_SDT) && defined(HAVE_SYS_SDT_H)
+XPYB_PROBE_SEMAPHORE(request__send);
+XPYB_PROBE_SEMAPHORE(reply__begin);
+XPYB_PROBE_SEMAPHORE(reply__end);
+XPYB_PROBE_SEMAPHORE(event);
+XPYB_PROBE_SEMAPHORE(error);
+#endif
+
+
+/*
+ * Helpers
+ */
+
+/*
+ * Monotonic clock in seconds, for timing that must not jump with the
+ * wall clock.
+ */
+double
+xpybModule_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 
 /*
  * Module functions
@@ -40,8 +78,10 @@ PyObject *xpybModule_ext_errors;
 static PyObject *
 xpyb_connect(PyObject *self, PyObject *args, PyObject *kw)
 {
-    xpybConn *conn = PyObject_New(xpybConn, &xpybConn_type);
+    xpybConn *conn;
 
+    /* Go through tp_new so the private state is allocated */
+    conn = (xpybConn *)xpybConn_type.tp_new(&xpybConn_type, NULL, NULL);
     if (conn == NULL)
 	return NULL;
 
@@ -57,6 +97,7 @@ xpyb_wrap(PyObject *self, PyObject *args)
     PyObject *obj;
     void *raw;
     xpybConn *conn;
+    double start = xpybModule_now();
 
     /* Make sure core was set. */
     if (xpybModule_core == NULL) {
@@ -69,7 +110,7 @@ xpyb_wrap(PyObject *self, PyObject *args)
 	return NULL;
 
     /* Create Python object */
-    conn = PyObject_New(xpybConn, &xpybConn_type);
+    conn = (xpybConn *)xpybConn_type.tp_new(&xpybConn_type, NULL, NULL);
     if (conn == NULL)
 	return NULL;
 
@@ -91,6 +132,7 @@ xpyb_wrap(PyObject *self, PyObject *args)
     if (xpybConn_setup(conn) < 0)
 	goto err;
 
+    conn->priv->startup_time = xpybModule_now() - start;
     return (PyObject *)conn;
 err:
     Py_DECREF(conn);
@@ -155,17 +197,17 @@ xpyb_resize_obj(PyObject *self, PyObject *args)
 {
     xpybProtobj *obj;
     Py_ssize_t size;
-    PyObject *buf;
 
     if (!PyArg_ParseTuple(args, "O!n", &xpybProtobj_type, &obj, &size))
 	return NULL;
 
-    buf = PyBuffer_FromObject(obj->buf, 0, size);
-    if (buf == NULL)
+    if (size < 0) {
+	PyErr_SetString(PyExc_ValueError, "Size must be zero or positive.");
 	return NULL;
+    }
 
-    Py_CLEAR(obj->buf);
-    obj->buf = buf;
+    if (obj->size == Py_END_OF_BUFFER || size < obj->size)
+	obj->size = size;
 
     Py_RETURN_NONE;
 }
@@ -192,6 +234,78 @@ xpyb_type_pad(PyObject *self, PyObject *args)
     return Py_BuildValue("I", -i & (t > 4 ? 3 : t - 1));
 }
 
+static PyObject *
+xpyb_lazy_module(PyObject *self, PyObject *args)
+{
+    const char *name;
+
+    if (!PyArg_ParseTuple(args, "s", &name))
+	return NULL;
+
+    return xpybLazymod_install(name);
+}
+
+static PyObject *
+xpyb_check_all(PyObject *self, PyObject *args)
+{
+    PyObject *cookies;
+
+    if (!PyArg_ParseTuple(args, "O", &cookies))
+	return NULL;
+
+    return xpybCookie_check_all(cookies);
+}
+
+static PyObject *
+xpyb_freelist_stats(PyObject *self, PyObject *args)
+{
+    return xpybFreelist_stats();
+}
+
+static PyObject *
+xpyb_memory_stats(PyObject *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "enable", NULL };
+    PyObject *enable = Py_None;
+    int enabled;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O", kwlist, &enable))
+	return NULL;
+
+    if (enable != Py_None) {
+	enabled = PyObject_IsTrue(enable);
+	if (enabled < 0)
+	    return NULL;
+	xpybMemstat_enable(enabled);
+    }
+
+    if (!xpybMemstat_enabled)
+	Py_RETURN_NONE;
+
+    return xpybMemstat_report();
+}
+
+static PyObject *
+xpyb_replay_events(PyObject *self, PyObject *args, PyObject *kw)
+{
+    return xpybReplay_run(args, kw);
+}
+
+static PyObject *
+xpyb_set_freelist_max(PyObject *self, PyObject *args)
+{
+    const char *name;
+    int max;
+
+    if (!PyArg_ParseTuple(args, "si", &name, &max))
+	return NULL;
+
+    if (xpybFreelist_set_max(name, max) < 0)
+	return NULL;
+
+    Py_RETURN_NONE;
+}
+
 
 static PyMethodDef XCBMethods[] = {
     { "connect",
@@ -214,6 +328,31 @@ static PyMethodDef XCBMethods[] = {
       METH_VARARGS,
       "Returns number of padding bytes needed for a type size." },
 
+    { "check_all",
+      (PyCFunction)xpyb_check_all,
+      METH_VARARGS,
+      "Checks a sequence of void checked cookies with one round trip per connection." },
+
+    { "freelist_stats",
+      (PyCFunction)xpyb_freelist_stats,
+      METH_NOARGS,
+      "Returns size, limit, hit and miss counts of the object freelists." },
+
+    { "memory_stats",
+      (PyCFunction)xpyb_memory_stats,
+      METH_VARARGS | METH_KEYWORDS,
+      "Returns live counts and bytes of protocol objects and buffers." },
+
+    { "replay_events",
+      (PyCFunction)xpyb_replay_events,
+      METH_VARARGS | METH_KEYWORDS,
+      "Decodes recorded events as fast as possible and reports the rate per event code." },
+
+    { "set_freelist_max",
+      (PyCFunction)xpyb_set_freelist_max,
+      METH_VARARGS,
+      "Sets how many objects a freelist may hold." },
+
     { "_add_core",
       (PyCFunction)xpyb_add_core,
       METH_VARARGS,
@@ -224,6 +363,11 @@ static PyMethodDef XCBMethods[] = {
       METH_VARARGS,
       "Registers a new extension protocol class.  Not meant for end users." },
 
+    { "_lazy_module",
+      (PyCFunction)xpyb_lazy_module,
+      METH_VARARGS,
+      "Replaces a generated module with its lazy version.  Not meant for end users." },
+
     { "_resize_obj",
       (PyCFunction)xpyb_resize_obj,
       METH_VARARGS,
@@ -232,10 +376,6 @@ static PyMethodDef XCBMethods[] = {
     { NULL } /* terminator */
 };
 
-static xpyb_CAPI_t CAPI = {
-    &xpybConn_type,
-};
-
 /*
  * Module init
  */
@@ -275,6 +415,8 @@ initxcb(void)
 
     if (xpybProtobj_modinit(m) < 0)
 	return;
+    if (xpybRawbuf_modinit(m) < 0)
+	return;
     if (xpybResponse_modinit(m) < 0)
 	return;
     if (xpybEvent_modinit(m) < 0)
@@ -297,7 +439,16 @@ initxcb(void)
 
     if (xpybVoid_modinit(m) < 0)
 	return;
+    if (xpybLazymod_modinit(m) < 0)
+	return;
+    if (xpybSetupidx_modinit(m) < 0)
+	return;
+    if (xpybMux_modinit(m) < 0)
+	return;
+    if (xpybRing_modinit(m) < 0)
+	return;
 
     /* Export C API for other modules */
-    PyModule_AddObject(m, "CAPI", PyCObject_FromVoidPtr(&CAPI, NULL));
+    PyModule_AddObject(m, "CAPI", PyCObject_FromVoidPtr(&xpybCAPI, NULL));
+    PyModule_AddObject(m, "C_API", PyCapsule_New(&xpybCAPI, "xcb.C_API", NULL));
 }
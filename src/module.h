@@ -16,6 +16,8 @@ extern PyObject *xpybModule_extdict;
 extern PyObject *xpybModule_ext_events;
 extern PyObject *xpybModule_ext_errors;
 
+double xpybModule_now(void);
+
 PyMODINIT_FUNC initxcb(void);
 
 #endif
@@ -0,0 +1,416 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "event.h"
+#include "error.h"
+#include "mux.h"
+
+#include <errno.h>
+#include <poll.h>
+
+/*
+ * Helpers
+ */
+
+static int
+xpybMux_dead(xpybConn *conn)
+{
+    return conn->conn == NULL || xcb_connection_has_error(conn->conn);
+}
+
+static int
+xpybMux_append(PyObject *batch, xpybConn *conn, PyObject *obj)
+{
+    PyObject *item;
+    int rc;
+
+    if (obj == NULL)
+	return -1;
+    item = PyTuple_Pack(2, conn, obj);
+    Py_DECREF(obj);
+    if (item == NULL)
+	return -1;
+    rc = PyList_Append(batch, item);
+    Py_DECREF(item);
+    return rc;
+}
+
+/*
+ * Wraps one response from the event queue.  Protocol errors are returned
+ * as exception instances rather than raised, so that one bad request does
+ * not throw away the rest of the batch.
+ */
+static PyObject *
+xpybMux_response(xpybConn *conn, xcb_generic_event_t *data)
+{
+    if (data->response_type != 0)
+	return xpybEvent_create(conn, data);
+
+    return xpybError_exception(conn, (xcb_generic_error_t *)data);
+}
+
+/*
+ * Takes up to quota responses from each connection, starting with a
+ * different connection every call.  Only connections flagged in ready
+ * read from their socket; the others just empty what libxcb has queued.
+ * Connections that have failed are reported once as (conn, None) and
+ * dropped.
+ */
+static int
+xpybMux_drain(xpybMux *self, PyObject *batch, const struct pollfd *ready)
+{
+    Py_ssize_t i, j, k, n = PyList_GET_SIZE(self->conns);
+    xcb_generic_event_t *data;
+    PyObject *conns;
+    xpybConn *conn;
+    int count, rc = -1;
+
+    if (n == 0)
+	return 0;
+
+    /* Work on a copy, since creating an event may run Python code */
+    conns = PyList_GetSlice(self->conns, 0, n);
+    if (conns == NULL)
+	return -1;
+
+    for (k = 0; k < n; k++) {
+	i = (self->next + k) % n;
+	conn = (xpybConn *)PyList_GET_ITEM(conns, i);
+
+	if (!xpybMux_dead(conn))
+	    xpybConn_check_latency(conn);
+
+	for (count = 0; count < self->quota; count++) {
+	    if (xpybMux_dead(conn))
+		break;
+	    if (ready && ready[i].revents)
+		data = xcb_poll_for_event(conn->conn);
+	    else
+		data = xcb_poll_for_queued_event(conn->conn);
+	    if (data == NULL)
+		break;
+	    if (data->response_type == 0 && xpybConn_ignored(conn, (xcb_generic_error_t *)data)) {
+		free(data);
+		continue;
+	    }
+	    if (data->response_type == 0 && conn->priv->defer_errors) {
+		if (xpybConn_defer_error(conn, (xcb_generic_error_t *)data) < 0)
+		    goto out;
+		continue;
+	    }
+	    if (xpybMux_append(batch, conn, xpybMux_response(conn, data)) < 0)
+		goto out;
+	}
+
+	if (xpybMux_dead(conn)) {
+	    for (j = 0; j < PyList_GET_SIZE(self->conns); j++)
+		if (PyList_GET_ITEM(self->conns, j) == (PyObject *)conn)
+		    break;
+	    if (j == PyList_GET_SIZE(self->conns))
+		continue;
+	    if (PySequence_DelItem(self->conns, j) < 0)
+		goto out;
+	    Py_INCREF(Py_None);
+	    if (xpybMux_append(batch, conn, Py_None) < 0)
+		goto out;
+	}
+    }
+
+    n = PyList_GET_SIZE(self->conns);
+    self->next = n ? (self->next + 1) % n : 0;
+    rc = 0;
+out:
+    Py_DECREF(conns);
+    return rc;
+}
+
+static PyObject *
+xpybMux_poll(xpybMux *self, PyObject *batch, int ms)
+{
+    Py_ssize_t i, n = PyList_GET_SIZE(self->conns);
+    xpybConn *conn;
+    struct pollfd *fds;
+    int rc;
+
+    fds = calloc(n, sizeof(*fds));
+    if (fds == NULL)
+	return PyErr_NoMemory();
+
+    for (i = 0; i < n; i++) {
+	conn = (xpybConn *)PyList_GET_ITEM(self->conns, i);
+	fds[i].fd = xcb_get_file_descriptor(conn->conn);
+	fds[i].events = POLLIN;
+	xcb_flush(conn->conn);
+	if (conn->priv->pending_requests > 0)
+	    xpybConn_flushed(conn, XPYB_FLUSH_WAIT);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rc = poll(fds, n, ms);
+    Py_END_ALLOW_THREADS
+
+    if (rc < 0) {
+	free(fds);
+	if (errno == EINTR)
+	    return PyErr_CheckSignals() < 0 ? NULL : batch;
+	return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if (rc > 0 && xpybMux_drain(self, batch, fds) < 0)
+	batch = NULL;
+    free(fds);
+    return batch;
+}
+
+
+/*
+ * Infrastructure
+ */
+
+static int
+xpybMux_init(xpybMux *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "connections", "quota", NULL };
+    PyObject *conns = NULL, *iter, *obj;
+
+    self->quota = XPYB_MUX_QUOTA;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|Oi", kwlist, &conns, &self->quota))
+	return -1;
+
+    if (self->quota < 1) {
+	PyErr_SetString(PyExc_ValueError, "Quota must be positive.");
+	return -1;
+    }
+
+    Py_CLEAR(self->conns);
+    self->conns = PyList_New(0);
+    if (self->conns == NULL)
+	return -1;
+    if (conns == NULL)
+	return 0;
+
+    iter = PyObject_GetIter(conns);
+    if (iter == NULL)
+	return -1;
+
+    while ((obj = PyIter_Next(iter)) != NULL) {
+	if (!PyObject_TypeCheck(obj, &xpybConn_type)) {
+	    PyErr_SetString(PyExc_TypeError, "Multiplexer only accepts xcb.Connection objects.");
+	    Py_DECREF(obj);
+	    break;
+	}
+	if (PyList_Append(self->conns, obj) < 0) {
+	    Py_DECREF(obj);
+	    break;
+	}
+	Py_DECREF(obj);
+    }
+
+    Py_DECREF(iter);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+static void
+xpybMux_dealloc(xpybMux *self)
+{
+    Py_CLEAR(self->conns);
+    self->ob_type->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+xpybMux_length(xpybMux *self)
+{
+    return self->conns ? PyList_GET_SIZE(self->conns) : 0;
+}
+
+
+/*
+ * Members
+ */
+
+static PyMemberDef xpybMux_members[] = {
+    { "quota",
+      T_INT,
+      offsetof(xpybMux, quota),
+      0,
+      "Maximum number of events taken from one connection per wait() call." },
+
+    { NULL } /* terminator */
+};
+
+
+/*
+ * Methods
+ */
+
+static PyObject *
+xpybMux_add(xpybMux *self, PyObject *args)
+{
+    PyObject *conn;
+
+    if (!PyArg_ParseTuple(args, "O!", &xpybConn_type, &conn))
+	return NULL;
+
+    if (PySequence_Contains(self->conns, conn) == 0)
+	if (PyList_Append(self->conns, conn) < 0)
+	    return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybMux_remove(xpybMux *self, PyObject *args)
+{
+    Py_ssize_t i;
+    PyObject *conn;
+
+    if (!PyArg_ParseTuple(args, "O!", &xpybConn_type, &conn))
+	return NULL;
+
+    for (i = 0; i < PyList_GET_SIZE(self->conns); i++)
+	if (PyList_GET_ITEM(self->conns, i) == conn) {
+	    if (PySequence_DelItem(self->conns, i) < 0)
+		return NULL;
+	    Py_RETURN_NONE;
+	}
+
+    PyErr_SetString(PyExc_ValueError, "Connection is not in the multiplexer.");
+    return NULL;
+}
+
+static PyObject *
+xpybMux_flush(xpybMux *self, PyObject *args)
+{
+    Py_ssize_t i;
+    xpybConn *conn;
+
+    for (i = 0; i < PyList_GET_SIZE(self->conns); i++) {
+	conn = (xpybConn *)PyList_GET_ITEM(self->conns, i);
+	if (!xpybMux_dead(conn)) {
+	    xcb_flush(conn->conn);
+	    xpybConn_flushed(conn, XPYB_FLUSH_MANUAL);
+	}
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybMux_wait(xpybMux *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "timeout", NULL };
+    PyObject *timeout = Py_None, *batch;
+    double secs, deadline = 0, left;
+    int ms = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O", kwlist, &timeout))
+	return NULL;
+
+    if (timeout != Py_None) {
+	secs = PyFloat_AsDouble(timeout);
+	if (secs == -1.0 && PyErr_Occurred())
+	    return NULL;
+	deadline = xpybModule_now() + secs;
+    }
+
+    batch = PyList_New(0);
+    if (batch == NULL)
+	return NULL;
+
+    if (xpybMux_drain(self, batch, NULL) < 0)
+	goto fail;
+
+    /*
+     * A readable socket may hold only part of a response, or only
+     * responses that are filtered out, so keep polling with whatever
+     * time is left until something arrives.
+     */
+    while (PyList_GET_SIZE(batch) == 0 && PyList_GET_SIZE(self->conns) > 0) {
+	if (timeout != Py_None) {
+	    left = deadline - xpybModule_now();
+	    ms = left <= 0 ? 0 : (int)(left * 1000 + 0.999);
+	}
+	if (xpybMux_poll(self, batch, ms) == NULL)
+	    goto fail;
+	if (ms == 0)
+	    break;
+    }
+
+    return batch;
+fail:
+    Py_DECREF(batch);
+    return NULL;
+}
+
+static PyObject *
+xpybMux_connections(xpybMux *self, PyObject *args)
+{
+    return PyList_AsTuple(self->conns);
+}
+
+static PyMethodDef xpybMux_methods[] = {
+    { "add",
+      (PyCFunction)xpybMux_add,
+      METH_VARARGS,
+      "Adds a connection to the multiplexer." },
+
+    { "remove",
+      (PyCFunction)xpybMux_remove,
+      METH_VARARGS,
+      "Removes a connection from the multiplexer." },
+
+    { "flush",
+      (PyCFunction)xpybMux_flush,
+      METH_NOARGS,
+      "Flushes every connection." },
+
+    { "wait",
+      (PyCFunction)xpybMux_wait,
+      METH_VARARGS | METH_KEYWORDS,
+      "Waits until at least one connection has events and returns a list of (connection, event) pairs." },
+
+    { "connections",
+      (PyCFunction)xpybMux_connections,
+      METH_NOARGS,
+      "Returns a tuple of the connections in the multiplexer." },
+
+    { NULL } /* terminator */
+};
+
+
+/*
+ * Definition
+ */
+
+static PySequenceMethods xpybMux_seqops = {
+    .sq_length = (lenfunc)xpybMux_length
+};
+
+PyTypeObject xpybMux_type = {
+    PyObject_HEAD_INIT(NULL)
+    .tp_name = "xcb.Multiplexer",
+    .tp_basicsize = sizeof(xpybMux),
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)xpybMux_init,
+    .tp_dealloc = (destructor)xpybMux_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG,
+    .tp_doc = "XCB multiplexer waiting on several connections at once",
+    .tp_methods = xpybMux_methods,
+    .tp_members = xpybMux_members,
+    .tp_as_sequence = &xpybMux_seqops
+};
+
+
+/*
+ * Module init
+ */
+int xpybMux_modinit(PyObject *m)
+{
+    if (PyType_Ready(&xpybMux_type) < 0)
+        return -1;
+    Py_INCREF(&xpybMux_type);
+    if (PyModule_AddObject(m, "Multiplexer", (PyObject *)&xpybMux_type) < 0)
+	return -1;
+
+    return 0;
+}
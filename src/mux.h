@@ -0,0 +1,20 @@
+#ifndef XPYB_MUX_H
+#define XPYB_MUX_H
+
+#include "conn.h"
+
+/* Default number of events taken from one connection per wait() */
+#define XPYB_MUX_QUOTA 64
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *conns;
+    Py_ssize_t next;
+    int quota;
+} xpybMux;
+
+extern PyTypeObject xpybMux_type;
+
+int xpybMux_modinit(PyObject *m);
+
+#endif
@@ -0,0 +1,180 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "cookie.h"
+#include "phase.h"
+
+/*
+ * Phase timing.  Splits the cost of each request type into encoding in
+ * the generated Python code, handing the request to libxcb, blocking for
+ * the reply and building the reply object.  Times are summed per
+ * (extension, opcode) in a growing array that cookies index into, so
+ * entries are never moved or freed while the connection lives.
+ */
+
+/*
+ * Helpers
+ */
+
+static int
+xpybPhase_lookup(xpybConn *conn, PyObject *extname, int opcode)
+{
+    PyObject *key, *index;
+    xpybPhaseEntry *newmem;
+    int i = -1;
+
+    key = Py_BuildValue("(Oi)", extname, opcode);
+    if (key == NULL)
+	goto out;
+
+    index = PyDict_GetItem(conn->priv->phase_index, key);
+    if (index != NULL) {
+	i = PyInt_AS_LONG(index);
+	goto out;
+    }
+
+    newmem = realloc(conn->priv->phases, (conn->priv->phases_len + 1) * sizeof(*newmem));
+    if (newmem == NULL)
+	goto out;
+    conn->priv->phases = newmem;
+
+    index = PyInt_FromLong(conn->priv->phases_len);
+    if (index == NULL || PyDict_SetItem(conn->priv->phase_index, key, index) < 0) {
+	Py_XDECREF(index);
+	goto out;
+    }
+    Py_DECREF(index);
+
+    i = conn->priv->phases_len++;
+    memset(newmem + i, 0, sizeof(*newmem));
+    Py_INCREF(newmem[i].key = key);
+out:
+    Py_XDECREF(key);
+    PyErr_Clear();
+    return i;
+}
+
+/*
+ * Called right after a request was handed to libxcb.  The encoding phase
+ * runs from the begin_request() call the generated code makes while
+ * timing is on up to send_request(); requests from code that does not
+ * make that call only count the send phase.
+ */
+void
+xpybPhase_sent(xpybConn *conn, xpybCookie *cookie, PyObject *extname,
+	       int opcode, double start, double end)
+{
+    xpybPhaseEntry *entry;
+    int i;
+
+    i = xpybPhase_lookup(conn, extname, opcode);
+    if (i < 0)
+	return;
+
+    entry = conn->priv->phases + i;
+    entry->requests++;
+    entry->send += end - start;
+    if (conn->priv->phase_mark > 0 && conn->priv->phase_mark <= start)
+	entry->encode += start - conn->priv->phase_mark;
+    conn->priv->phase_mark = 0;
+
+    if (!cookie->request->is_void)
+	cookie->phase_entry = i + 1;
+}
+
+/*
+ * Adds the time spent waiting for a reply, or building the reply object
+ * from it, to the entry of the request the cookie belongs to.
+ */
+void
+xpybPhase_add(xpybConn *conn, xpybCookie *cookie, int wait, double t)
+{
+    xpybPhaseEntry *entry;
+
+    if (!conn->priv->phase_timing || cookie->phase_entry == 0)
+	return;
+
+    entry = conn->priv->phases + cookie->phase_entry - 1;
+    if (wait) {
+	entry->replies++;
+	entry->wait += t;
+    }
+    else
+	entry->decode += t;
+}
+
+/*
+ * Turning timing on starts from zero; turning it off keeps the totals so
+ * that they can still be reported.
+ */
+int
+xpybPhase_enable(xpybConn *conn, int enabled)
+{
+    int i;
+
+    conn->priv->phase_mark = 0;
+    conn->priv->phase_timing = enabled;
+    if (!enabled)
+	return 0;
+
+    if (conn->priv->phase_index == NULL) {
+	conn->priv->phase_index = PyDict_New();
+	if (conn->priv->phase_index == NULL) {
+	    conn->priv->phase_timing = 0;
+	    return -1;
+	}
+    }
+
+    for (i = 0; i < conn->priv->phases_len; i++) {
+	conn->priv->phases[i].requests = conn->priv->phases[i].replies = 0;
+	conn->priv->phases[i].encode = conn->priv->phases[i].send = 0;
+	conn->priv->phases[i].wait = conn->priv->phases[i].decode = 0;
+    }
+    return 0;
+}
+
+void
+xpybPhase_clear(xpybConn *conn)
+{
+    int i;
+
+    for (i = 0; i < conn->priv->phases_len; i++)
+	Py_CLEAR(conn->priv->phases[i].key);
+    free(conn->priv->phases);
+    conn->priv->phases = NULL;
+    conn->priv->phases_len = 0;
+    Py_CLEAR(conn->priv->phase_index);
+}
+
+PyObject *
+xpybPhase_report(xpybConn *conn)
+{
+    PyObject *result, *value;
+    xpybPhaseEntry *entry;
+    int i;
+
+    result = PyDict_New();
+    if (result == NULL)
+	return NULL;
+
+    for (i = 0; i < conn->priv->phases_len; i++) {
+	entry = conn->priv->phases + i;
+	if (entry->requests == 0 && entry->replies == 0)
+	    continue;
+	value = Py_BuildValue("{sksksdsdsdsd}",
+			      "requests", entry->requests,
+			      "replies", entry->replies,
+			      "encode", entry->encode,
+			      "send", entry->send,
+			      "wait", entry->wait,
+			      "decode", entry->decode);
+	if (value == NULL || PyDict_SetItem(result, entry->key, value) < 0) {
+	    Py_XDECREF(value);
+	    Py_DECREF(result);
+	    return NULL;
+	}
+	Py_DECREF(value);
+    }
+
+    return result;
+}
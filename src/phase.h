@@ -0,0 +1,15 @@
+#ifndef XPYB_PHASE_H
+#define XPYB_PHASE_H
+
+#include "conn.h"
+#include "cookie.h"
+
+void xpybPhase_sent(xpybConn *conn, xpybCookie *cookie, PyObject *extname,
+		    int opcode, double start, double end);
+void xpybPhase_add(xpybConn *conn, xpybCookie *cookie, int wait, double t);
+
+int xpybPhase_enable(xpybConn *conn, int enabled);
+void xpybPhase_clear(xpybConn *conn);
+PyObject *xpybPhase_report(xpybConn *conn);
+
+#endif
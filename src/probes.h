@@ -0,0 +1,50 @@
+#ifndef XPYB_PROBES_H
+#define XPYB_PROBES_H
+
+/*
+ * Static tracepoints for perf, bpftrace and SystemTap, compiled in when
+ * configured with --enable-sdt.  Each probe has a semaphore that tracers
+ * raise while attached, and the arguments are only computed when it is
+ * set.  XPYB_PROBE_ENABLED(name) tests the semaphore, so code that only
+ * gathers probe arguments can be skipped as well; without --enable-sdt
+ * it is 0 and the probe macros expand to nothing.  All probes are in the
+ * "xpyb" provider.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(XPYB_ENABLE_SDT) && defined(HAVE_SYS_SDT_H)
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define XPYB_PROBE_SEMAPHORE(name) \
+    unsigned short xpyb_##name##_semaphore \
+	__attribute__((unused)) __attribute__((section(".probes")))
+
+extern XPYB_PROBE_SEMAPHORE(request__send);
+extern XPYB_PROBE_SEMAPHORE(reply__begin);
+extern XPYB_PROBE_SEMAPHORE(reply__end);
+extern XPYB_PROBE_SEMAPHORE(event);
+extern XPYB_PROBE_SEMAPHORE(error);
+
+#define XPYB_PROBE_ENABLED(name) __builtin_expect(xpyb_##name##_semaphore, 0)
+#define XPYB_PROBE1(name, a) \
+    do { if (XPYB_PROBE_ENABLED(name)) DTRACE_PROBE1(xpyb, name, a); } while (0)
+#define XPYB_PROBE2(name, a, b) \
+    do { if (XPYB_PROBE_ENABLED(name)) DTRACE_PROBE2(xpyb, name, a, b); } while (0)
+#define XPYB_PROBE4(name, a, b, c, d) \
+    do { if (XPYB_PROBE_ENABLED(name)) DTRACE_PROBE4(xpyb, name, a, b, c, d); } while (0)
+
+#else
+
+#define XPYB_PROBE_ENABLED(name) 0
+#define XPYB_PROBE1(name, a) do { } while (0)
+#define XPYB_PROBE2(name, a, b) do { } while (0)
+#define XPYB_PROBE4(name, a, b, c, d) do { } while (0)
+
+#endif
+
+#endif
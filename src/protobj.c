@@ -1,6 +1,58 @@
 #include "module.h"
 #include "except.h"
 #include "protobj.h"
+#include "rawbuf.h"
+#include "freelist.h"
+
+/*
+ * Helpers
+ */
+
+/*
+ * Resolves the object's window onto its underlying buffer.  The window is
+ * kept as a plain offset and size rather than a buffer object, so nested
+ * structures share the root buffer without an extra object each.
+ */
+int
+xpybProtobj_data(xpybProtobj *self, const void **p, Py_ssize_t *size)
+{
+    const char *data;
+    Py_ssize_t len, offset = self->offset;
+
+    if (self->buf == NULL) {
+	PyErr_SetString(xpybExcept_base, "Protocol object has no buffer.");
+	return -1;
+    }
+    if (self->buf->ob_type == &xpybRawbuf_type) {
+	data = ((xpybRawbuf *)self->buf)->data;
+	len = ((xpybRawbuf *)self->buf)->size;
+    } else if (PyObject_AsReadBuffer(self->buf, (const void **)&data, &len) < 0)
+	return -1;
+
+    if (offset > len)
+	offset = len;
+    len -= offset;
+    if (self->size != Py_END_OF_BUFFER && self->size < len)
+	len = self->size;
+
+    *p = data + offset;
+    *size = len;
+    return 0;
+}
+
+/*
+ * Builds a temporary buffer object over the window, used for the less
+ * common sequence operations.
+ */
+static PyObject *
+xpybProtobj_view(xpybProtobj *self)
+{
+    if (self->buf == NULL) {
+	PyErr_SetString(xpybExcept_base, "Protocol object has no buffer.");
+	return NULL;
+    }
+    return PyBuffer_FromObject(self->buf, self->offset, self->size);
+}
 
 
 /*
@@ -10,7 +62,13 @@
 static PyObject *
 xpybProtobj_new(PyTypeObject *self, PyObject *args, PyObject *kw)
 {
-    return PyType_GenericNew(self, args, kw);
+    xpybProtobj *obj;
+
+    obj = (xpybProtobj *)xpybFreelist_new(&xpybFreelist_protobj, self);
+    if (obj != NULL)
+	obj->size = Py_END_OF_BUFFER;
+
+    return (PyObject *)obj;
 }
 
 static int
@@ -24,10 +82,43 @@ xpybProtobj_init(xpybProtobj *self, PyObject *args, PyObject *kw)
 				     &parent, &offset, &size))
 	return -1;
 
-    self->buf = PyBuffer_FromObject(parent, offset, size);
-    if (self->buf == NULL)
+    if (offset < 0) {
+	PyErr_SetString(PyExc_ValueError, "Offset must be zero or positive.");
+	return -1;
+    }
+    if (size < 0 && size != Py_END_OF_BUFFER) {
+	PyErr_SetString(PyExc_ValueError, "Size must be zero or positive.");
+	return -1;
+    }
+
+    /* Collapse onto the root buffer when nested inside another object */
+    if (PyObject_TypeCheck(parent, &xpybProtobj_type)) {
+	xpybProtobj *outer = (xpybProtobj *)parent;
+
+	if (outer->buf == NULL) {
+	    PyErr_SetString(PyExc_TypeError, "Parent has not been initialized.");
+	    return -1;
+	}
+	if (outer->size != Py_END_OF_BUFFER) {
+	    Py_ssize_t max = outer->size > offset ? outer->size - offset : 0;
+
+	    if (size == Py_END_OF_BUFFER || size > max)
+		size = max;
+	}
+	offset += outer->offset;
+	parent = outer->buf;
+    }
+
+    if (PyObject_CheckReadBuffer(parent) == 0) {
+	PyErr_SetString(PyExc_TypeError, "Parent does not support the buffer interface.");
 	return -1;
+    }
 
+    Py_INCREF(parent);
+    Py_CLEAR(self->buf);
+    self->buf = parent;
+    self->offset = offset;
+    self->size = size;
     return 0;
 }
 
@@ -35,85 +126,138 @@ static void
 xpybProtobj_dealloc(xpybProtobj *self)
 {
     Py_CLEAR(self->buf);
-    self->ob_type->tp_free((PyObject *)self);
+    xpybFreelist_free(&xpybFreelist_protobj, (PyObject *)self);
 }
 
 static Py_ssize_t
 xpybProtobj_readbuf(xpybProtobj *self, Py_ssize_t s, void **p)
 {
-    return PyBuffer_Type.tp_as_buffer->bf_getreadbuffer(self->buf, s, p);
+    Py_ssize_t size;
+
+    if (s != 0) {
+	PyErr_SetString(PyExc_SystemError, "Accessing non-existent segment.");
+	return -1;
+    }
+    if (xpybProtobj_data(self, (const void **)p, &size) < 0)
+	return -1;
+
+    return size;
 }
 
 static Py_ssize_t
 xpybProtobj_segcount(xpybProtobj *self, Py_ssize_t *s)
 {
-    return PyBuffer_Type.tp_as_buffer->bf_getsegcount(self->buf, s);
+    const void *p;
+    Py_ssize_t size;
+
+    if (s) {
+	if (xpybProtobj_data(self, &p, &size) < 0)
+	    return -1;
+	*s = size;
+    }
+    return 1;
 }
 
 static Py_ssize_t
 xpybProtobj_charbuf(xpybProtobj *self, Py_ssize_t s, char **p)
 {
-    return PyBuffer_Type.tp_as_buffer->bf_getcharbuffer(self->buf, s, p);
+    return xpybProtobj_readbuf(self, s, (void **)p);
 }
 
 static Py_ssize_t
 xpybProtobj_length(xpybProtobj *self)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_length(self->buf);
+    const void *p;
+    Py_ssize_t size;
+
+    if (xpybProtobj_data(self, &p, &size) < 0)
+	return -1;
+
+    return size;
 }
 
 static PyObject *
 xpybProtobj_concat(xpybProtobj *self, PyObject *arg)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_concat(self->buf, arg);
+    PyObject *view = xpybProtobj_view(self);
+    PyObject *result;
+
+    if (view == NULL)
+	return NULL;
+
+    result = PyBuffer_Type.tp_as_sequence->sq_concat(view, arg);
+    Py_DECREF(view);
+    return result;
 }
 
 static PyObject *
 xpybProtobj_repeat(xpybProtobj *self, Py_ssize_t arg)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_repeat(self->buf, arg);
+    PyObject *view = xpybProtobj_view(self);
+    PyObject *result;
+
+    if (view == NULL)
+	return NULL;
+
+    result = PyBuffer_Type.tp_as_sequence->sq_repeat(view, arg);
+    Py_DECREF(view);
+    return result;
 }
 
 static PyObject *
 xpybProtobj_item(xpybProtobj *self, Py_ssize_t arg)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_item(self->buf, arg);
+    PyObject *view = xpybProtobj_view(self);
+    PyObject *result;
+
+    if (view == NULL)
+	return NULL;
+
+    result = PyBuffer_Type.tp_as_sequence->sq_item(view, arg);
+    Py_DECREF(view);
+    return result;
 }
 
 static PyObject *
 xpybProtobj_slice(xpybProtobj *self, Py_ssize_t arg1, Py_ssize_t arg2)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_slice(self->buf, arg1, arg2);
+    PyObject *view = xpybProtobj_view(self);
+    PyObject *result;
+
+    if (view == NULL)
+	return NULL;
+
+    result = PyBuffer_Type.tp_as_sequence->sq_slice(view, arg1, arg2);
+    Py_DECREF(view);
+    return result;
 }
 
 static int
 xpybProtobj_ass_item(xpybProtobj *self, Py_ssize_t arg1, PyObject *arg2)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_ass_item(self->buf, arg1, arg2);
-}
+    PyObject *view = xpybProtobj_view(self);
+    int result;
 
-static int
-xpybProtobj_ass_slice(xpybProtobj *self, Py_ssize_t arg1, Py_ssize_t arg2, PyObject *arg3)
-{
-    return PyBuffer_Type.tp_as_sequence->sq_ass_slice(self->buf, arg1, arg2, arg3);
+    if (view == NULL)
+	return -1;
+
+    result = PyBuffer_Type.tp_as_sequence->sq_ass_item(view, arg1, arg2);
+    Py_DECREF(view);
+    return result;
 }
 
 static int
-xpybProtobj_contains(xpybProtobj *self, PyObject *arg)
+xpybProtobj_ass_slice(xpybProtobj *self, Py_ssize_t arg1, Py_ssize_t arg2, PyObject *arg3)
 {
-    return PyBuffer_Type.tp_as_sequence->sq_contains(self->buf, arg);
-}
+    PyObject *view = xpybProtobj_view(self);
+    int result;
 
-static PyObject *
-xpybProtobj_inplace_concat(xpybProtobj *self, PyObject *arg)
-{
-    return PyBuffer_Type.tp_as_sequence->sq_inplace_concat(self->buf, arg);
-}
+    if (view == NULL)
+	return -1;
 
-static PyObject *
-xpybProtobj_inplace_repeat(xpybProtobj *self, Py_ssize_t arg)
-{
-    return PyBuffer_Type.tp_as_sequence->sq_inplace_repeat(self->buf, arg);
+    result = PyBuffer_Type.tp_as_sequence->sq_ass_slice(view, arg1, arg2, arg3);
+    Py_DECREF(view);
+    return result;
 }
 
 
@@ -144,10 +288,7 @@ static PySequenceMethods xpybProtobj_seqops = {
     .sq_item = (ssizeargfunc)xpybProtobj_item,
     .sq_slice = (ssizessizeargfunc)xpybProtobj_slice,
     .sq_ass_item = (ssizeobjargproc)xpybProtobj_ass_item,
-    .sq_ass_slice = (ssizessizeobjargproc)xpybProtobj_ass_slice,
-    .sq_contains = (objobjproc)xpybProtobj_contains,
-    .sq_inplace_concat = (binaryfunc)xpybProtobj_inplace_concat,
-    .sq_inplace_repeat = (ssizeargfunc)xpybProtobj_inplace_repeat
+    .sq_ass_slice = (ssizessizeobjargproc)xpybProtobj_ass_slice
 };
 
 PyTypeObject xpybProtobj_type = {
@@ -157,7 +298,7 @@ PyTypeObject xpybProtobj_type = {
     .tp_init = (initproc)xpybProtobj_init,
     .tp_new = xpybProtobj_new,
     .tp_dealloc = (destructor)xpybProtobj_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic X protocol object",
     .tp_as_buffer = &xpybProtobj_bufops,
     .tp_as_sequence = &xpybProtobj_seqops
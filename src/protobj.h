@@ -4,10 +4,14 @@
 typedef struct {
     PyObject_HEAD
     PyObject *buf;
+    Py_ssize_t offset;
+    Py_ssize_t size;
 } xpybProtobj;
 
 extern PyTypeObject xpybProtobj_type;
 
+int xpybProtobj_data(xpybProtobj *self, const void **p, Py_ssize_t *size);
+
 int xpybProtobj_modinit(PyObject *m);
 
 #endif
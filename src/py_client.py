@@ -27,6 +27,7 @@ _cardinal_types = {'CARD8':  'B', 'uint8_t': 'B',
                    'double' : 'd'}
 _pylines = []
 _pylevel = 0
+_pyindent = ''
 _ns = None
 
 _py_fmt_fmt = ''
@@ -37,7 +38,8 @@ def _py(fmt, *args):
     '''
     Writes the given line to the header file.
     '''
-    _pylines[_pylevel].append(fmt % args)
+    line = fmt % args
+    _pylines[_pylevel].append(_pyindent + line if line else line)
 
 def _py_popline():
     _pylines[_pylevel][-1:] = ()
@@ -52,6 +54,26 @@ def _py_setlevel(idx):
         _pylines.append([])
     _pylevel = idx
     
+def _py_lazy_begin(name):
+    '''
+    Starts a top-level class definition.  The class is wrapped in a factory
+    function that the xcb.LazyModule calls the first time the name is used,
+    so that importing a protocol module does not create every class.
+    '''
+    global _pyindent
+    _py('')
+    _py('def _def_%s():', name)
+    _pyindent = '    '
+
+def _py_lazy_end(name):
+    '''
+    Ends a top-level class definition started with _py_lazy_begin().
+    '''
+    global _pyindent
+    _pyindent = ''
+    _py('    return %s', name)
+    _py('_lazy[\'%s\'] = _def_%s', name, name)
+
 def _t(str):
     '''
     Does Python-name conversion on a type tuple of strings.
@@ -118,6 +140,9 @@ def py_open(self):
     _py('import cStringIO')
     _py('from struct import pack, unpack_from')
     _py('from array import array')
+    _py('')
+    _py('# Classes are defined on first use; see xcb.LazyModule.')
+    _py('_lazy = {}')
         
     if _ns.is_ext:
         for (n, h) in self.imports:
@@ -135,6 +160,8 @@ def py_open(self):
 
     _py_setlevel(2)
     _py('')
+    _py('_m = xcb._lazy_module(__name__)')
+    _py('')
     _py('_events = {')
 
     _py_setlevel(3)
@@ -148,7 +175,7 @@ def py_open(self):
     if _ns.is_ext:
         _py('xcb._add_ext(key, %sExtension, _events, _errors)', _ns.header)
     else:
-        _py('xcb._add_core(%sExtension, Setup, _events, _errors)', _ns.header)
+        _py('xcb._add_core(%sExtension, _m.Setup, _events, _errors)', _ns.header)
     
 
 def py_close(self):
@@ -168,7 +195,7 @@ def py_enum(self, name):
     Exported function that handles enum declarations.
     '''
     _py_setlevel(0)
-    _py('')
+    _py_lazy_begin(_t(name))
     _py('class %s:', _t(name))
 
     count = 0
@@ -180,6 +207,8 @@ def py_enum(self, name):
         else:
             count += 1
 
+    _py_lazy_end(_t(name))
+
 def _py_type_setup(self, name, postfix=''):
     '''
     Sets up all the C-related state by adding additional data fields to
@@ -242,7 +271,7 @@ def _py_type_setup(self, name, postfix=''):
             if field.type.is_list:
                 _py_type_setup(field.type.member, field.field_type)
 
-                field.py_listtype = _t(field.type.member.name)
+                field.py_listtype = '_m.' + _t(field.type.member.name)
                 if field.type.member.is_simple:
                     field.py_listtype = "'" + field.type.member.py_format_str + "'"
 
@@ -298,6 +327,14 @@ def _py_type_alignsize(field):
         return field.type.size if field.type.fixed_size() else 4
     return field.type.size
         
+def _py_slots(self):
+    '''
+    Declares __slots__ for the fields a generated class assigns, so that
+    instances do not carry a per-instance dictionary.
+    '''
+    names = [_n(field.field_name) for field in self.fields if not field.auto and not field.type.is_pad]
+    _py('    __slots__ = (%s)', ''.join(["'%s', " % name for name in names]).rstrip())
+
 def _py_complex(self, name):
     need_alignment = False
 
@@ -326,10 +363,10 @@ def _py_complex(self, name):
             _py('        self.%s = xcb.List(parent, offset, %s, %s, %d)', _n(field.field_name), _py_get_expr(field.type.expr), field.py_listtype, field.py_listsize)
             _py('        offset += len(self.%s.buf())', _n(field.field_name))
         elif field.type.is_container and field.type.fixed_size():
-            _py('        self.%s = %s(parent, offset, %s)', _n(field.field_name), field.py_type, field.type.size)
+            _py('        self.%s = _m.%s(parent, offset, %s)', _n(field.field_name), field.py_type, field.type.size)
             _py('        offset += %s', field.type.size)
         else:
-            _py('        self.%s = %s(parent, offset)', _n(field.field_name), field.py_type)
+            _py('        self.%s = _m.%s(parent, offset)', _n(field.field_name), field.py_type)
             _py('        offset += len(self.%s)', _n(field.field_name))
 
     (format, size, list) = _py_flush_format()
@@ -350,8 +387,9 @@ def py_struct(self, name):
     _py_type_setup(self, name)
 
     _py_setlevel(0)
-    _py('')
+    _py_lazy_begin(self.py_type)
     _py('class %s(xcb.Struct):', self.py_type)
+    _py_slots(self)
     if self.fixed_size():
         _py('    def __init__(self, parent, offset, size):')
         _py('        xcb.Struct.__init__(self, parent, offset, size)')
@@ -365,6 +403,8 @@ def py_struct(self, name):
     if not self.fixed_size():
         _py('        xcb._resize_obj(self, offset - base)')
 
+    _py_lazy_end(self.py_type)
+
 def py_union(self, name):
     '''
     Exported function that handles union declarations.
@@ -372,8 +412,9 @@ def py_union(self, name):
     _py_type_setup(self, name)
 
     _py_setlevel(0)
-    _py('')
+    _py_lazy_begin(self.py_type)
     _py('class %s(xcb.Union):', self.py_type)
+    _py_slots(self)
     if self.fixed_size():
         _py('    def __init__(self, parent, offset, size):')
         _py('        xcb.Union.__init__(self, parent, offset, size)')
@@ -392,17 +433,19 @@ def py_union(self, name):
             if not self.fixed_size():
                 _py('        size = max(size, len(self.%s.buf()))', _n(field.field_name))
         elif field.type.is_container and field.type.fixed_size():
-            _py('        self.%s = %s(parent, offset, %s)', _n(field.field_name), field.py_type, field.type.size)
+            _py('        self.%s = _m.%s(parent, offset, %s)', _n(field.field_name), field.py_type, field.type.size)
             if not self.fixed_size():
                 _py('        size = max(size, %s)', field.type.size)
         else:
-            _py('        self.%s = %s(parent, offset)', _n(field.field_name), field.py_type)
+            _py('        self.%s = _m.%s(parent, offset)', _n(field.field_name), field.py_type)
             if not self.fixed_size():
                 _py('        size = max(size, len(self.%s))', _n(field.field_name))
 
     if not self.fixed_size():
         _py('        xcb._resize_obj(self, size)')
 
+    _py_lazy_end(self.py_type)
+
 def _py_reply(self, name):
     '''
     Handles reply declarations.
@@ -410,12 +453,15 @@ def _py_reply(self, name):
     _py_type_setup(self, name, 'Reply')
 
     _py_setlevel(0)
-    _py('')
+    _py_lazy_begin(self.py_reply_name)
     _py('class %s(xcb.Reply):', self.py_reply_name)
+    _py_slots(self)
     _py('    def __init__(self, parent, offset=0):')
     _py('        xcb.Reply.__init__(self, parent, offset)')
 
     _py_complex(self, name)
+
+    _py_lazy_end(self.py_reply_name)
     
 def _py_request_helper(self, name, void, regular):
     '''
@@ -441,7 +487,7 @@ def _py_request_helper(self, name, void, regular):
     unchecked = not void and not regular
 
     # What kind of cookie we return
-    func_cookie = 'xcb.VoidCookie' if void else self.py_cookie_name
+    func_cookie = 'xcb.VoidCookie' if void else '_m.' + self.py_cookie_name
 
     # What flag is passed to xcb_request
     func_flags = checked or (not void and regular)
@@ -467,6 +513,8 @@ def _py_request_helper(self, name, void, regular):
     _py_setlevel(1)
     _py('')
     _py('    def %s(self, %s):', func_name, ', '.join([_n(x.field_name) for x in param_fields]))
+    _py('        if self.phase_timing:')
+    _py('            self.begin_request()')
     _py('        buf = cStringIO.StringIO()')
 
     for field in wire_fields:
@@ -504,7 +552,7 @@ def _py_request_helper(self, name, void, regular):
     _py('        return self.send_request(xcb.Request(buf.getvalue(), %s, %s, %s),', self.opcode, _b(void), _b(func_flags))
     _py('                                 %s()%s', func_cookie, ')' if void else ',')
     if not void:
-        _py('                                 %s)', self.py_reply_name)
+        _py('                                 _m.%s)', self.py_reply_name)
 
 def py_request(self, name):
     '''
@@ -515,9 +563,10 @@ def py_request(self, name):
 
     if self.reply:
         # Cookie class declaration
-        _py('')
+        _py_lazy_begin(self.py_cookie_name)
         _py('class %s(xcb.Cookie):', self.py_cookie_name)
         _py('    pass')
+        _py_lazy_end(self.py_cookie_name)
 
     if self.reply:
         # Reply class definition
@@ -538,16 +587,19 @@ def py_event(self, name):
 
     # Structure definition
     _py_setlevel(0)
-    _py('')
+    _py_lazy_begin(self.py_event_name)
     _py('class %s(xcb.Event):', self.py_event_name)
+    _py_slots(self)
     _py('    def __init__(self, parent, offset=0):')
     _py('        xcb.Event.__init__(self, parent, offset)')
 
     _py_complex(self, name)
 
+    _py_lazy_end(self.py_event_name)
+
     # Opcode define
     _py_setlevel(2)
-    _py('    %s : %s,', self.opcodes[name], self.py_event_name)
+    _py('    %s : lambda: _m.%s,', self.opcodes[name], self.py_event_name)
 
 def py_error(self, name):
     '''
@@ -557,21 +609,25 @@ def py_error(self, name):
 
     # Structure definition
     _py_setlevel(0)
-    _py('')
+    _py_lazy_begin(self.py_error_name)
     _py('class %s(xcb.Error):', self.py_error_name)
+    _py_slots(self)
     _py('    def __init__(self, parent, offset=0):')
     _py('        xcb.Error.__init__(self, parent, offset)')
 
     _py_complex(self, name)
 
+    _py_lazy_end(self.py_error_name)
+
     # Exception definition
-    _py('')
+    _py_lazy_begin(self.py_except_name)
     _py('class %s(xcb.ProtocolException):', self.py_except_name)
     _py('    pass')
+    _py_lazy_end(self.py_except_name)
 
     # Opcode define
     _py_setlevel(3)
-    _py('    %s : (%s, %s),', self.opcodes[name], self.py_error_name, self.py_except_name)
+    _py('    %s : lambda: (_m.%s, _m.%s),', self.opcodes[name], self.py_error_name, self.py_except_name)
 
 
 # Main routine starts here
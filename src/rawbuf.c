@@ -0,0 +1,204 @@
+#include "module.h"
+#include "except.h"
+#include "rawbuf.h"
+#include "freelist.h"
+#include "memstat.h"
+
+/*
+ * Helpers
+ */
+
+static int
+xpybRawbuf_class(Py_ssize_t size)
+{
+    int i = 0;
+
+    while (i < XPYB_BUFCLASSES && (32 << i) < size)
+	i++;
+    return i;
+}
+
+/*
+ * Takes ownership of a malloc'd block, such as a reply handed out by
+ * libxcb.  The block is freed when the buffer object goes away.  On
+ * failure the block still belongs to the caller.
+ */
+PyObject *
+xpybRawbuf_create(void *data, Py_ssize_t size)
+{
+    xpybRawbuf *self;
+
+    self = (xpybRawbuf *)xpybFreelist_new(&xpybFreelist_rawbuf, &xpybRawbuf_type);
+
+    if (self == NULL)
+	return NULL;
+
+    self->data = data;
+    self->size = size;
+    self->pool = NULL;
+    if (xpybMemstat_enabled)
+	xpybMemstat_buffer(size);
+    return (PyObject *)self;
+}
+
+/*
+ * Returns a buffer of the given size whose memory comes from the
+ * connection's size-classed freelists, and goes back there when the
+ * buffer is freed.  Used for events and errors, which are small and
+ * arrive in large numbers.  The contents are left for the caller to
+ * fill in.
+ */
+xpybRawbuf *
+xpybRawbuf_alloc(xpybConn *conn, Py_ssize_t size)
+{
+    xpybRawbuf *self;
+    int i = xpybRawbuf_class(size);
+    void *data;
+
+    if (i < XPYB_BUFCLASSES && conn->priv->freebufs[i] != NULL) {
+	data = conn->priv->freebufs[i];
+	conn->priv->freebufs[i] = *(void **)data;
+	conn->priv->freebufs_len[i]--;
+    } else {
+	data = malloc(i < XPYB_BUFCLASSES ? 32 << i : size);
+	if (data == NULL)
+	    return (xpybRawbuf *)PyErr_NoMemory();
+    }
+
+    self = (xpybRawbuf *)xpybRawbuf_create(data, size);
+    if (self == NULL) {
+	free(data);
+	return NULL;
+    }
+
+    Py_INCREF(self->pool = conn);
+    return self;
+}
+
+void
+xpybRawbuf_clear_pool(xpybConn *conn)
+{
+    void *data;
+    int i;
+
+    for (i = 0; i < XPYB_BUFCLASSES; i++) {
+	while ((data = conn->priv->freebufs[i]) != NULL) {
+	    conn->priv->freebufs[i] = *(void **)data;
+	    free(data);
+	}
+	conn->priv->freebufs_len[i] = 0;
+    }
+}
+
+
+/*
+ * Infrastructure
+ */
+
+static void
+xpybRawbuf_dealloc(xpybRawbuf *self)
+{
+    xpybConn *conn = self->pool;
+    int i;
+
+    if (xpybMemstat_enabled)
+	xpybMemstat_buffer(-self->size);
+    if (conn == NULL)
+	free(self->data);
+    else {
+	i = xpybRawbuf_class(self->size);
+	if (i < XPYB_BUFCLASSES && conn->priv->freebufs_len[i] < XPYB_RAWBUF_MAXFREE) {
+	    *(void **)self->data = conn->priv->freebufs[i];
+	    conn->priv->freebufs[i] = self->data;
+	    conn->priv->freebufs_len[i]++;
+	} else
+	    free(self->data);
+	Py_DECREF(conn);
+    }
+
+    xpybFreelist_free(&xpybFreelist_rawbuf, (PyObject *)self);
+}
+
+static Py_ssize_t
+xpybRawbuf_readbuf(xpybRawbuf *self, Py_ssize_t s, void **p)
+{
+    if (s != 0) {
+	PyErr_SetString(PyExc_SystemError, "Accessing non-existent buffer segment.");
+	return -1;
+    }
+
+    *p = self->data;
+    return self->size;
+}
+
+static Py_ssize_t
+xpybRawbuf_segcount(xpybRawbuf *self, Py_ssize_t *s)
+{
+    if (s)
+	*s = self->size;
+    return 1;
+}
+
+static Py_ssize_t
+xpybRawbuf_charbuf(xpybRawbuf *self, Py_ssize_t s, char **p)
+{
+    return xpybRawbuf_readbuf(self, s, (void **)p);
+}
+
+static Py_ssize_t
+xpybRawbuf_length(xpybRawbuf *self)
+{
+    return self->size;
+}
+
+
+/*
+ * Members
+ */
+
+
+/*
+ * Methods
+ */
+
+
+/*
+ * Definition
+ */
+
+static PyBufferProcs xpybRawbuf_bufops = {
+    .bf_getreadbuffer = (readbufferproc)xpybRawbuf_readbuf,
+    .bf_getwritebuffer = (writebufferproc)xpybRawbuf_readbuf,
+    .bf_getsegcount = (segcountproc)xpybRawbuf_segcount,
+    .bf_getcharbuffer = (charbufferproc)xpybRawbuf_charbuf
+};
+
+static PySequenceMethods xpybRawbuf_seqops = {
+    .sq_length = (lenfunc)xpybRawbuf_length
+};
+
+PyTypeObject xpybRawbuf_type = {
+    PyObject_HEAD_INIT(NULL)
+    .tp_name = "xcb.RawBuffer",
+    .tp_basicsize = sizeof(xpybRawbuf),
+    .tp_dealloc = (destructor)xpybRawbuf_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG,
+    .tp_doc = "XCB buffer owning memory received from the X server",
+    .tp_as_buffer = &xpybRawbuf_bufops,
+    .tp_as_sequence = &xpybRawbuf_seqops
+};
+
+
+/*
+ * Module init
+ */
+int xpybRawbuf_modinit(PyObject *m)
+{
+    if (PyType_Ready(&xpybRawbuf_type) < 0)
+        return -1;
+    Py_INCREF(&xpybRawbuf_type);
+    if (PyModule_AddObject(m, "RawBuffer", (PyObject *)&xpybRawbuf_type) < 0)
+	return -1;
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef XPYB_RAWBUF_H
+#define XPYB_RAWBUF_H
+
+#include "conn.h"
+
+/* Number of free blocks kept per size class */
+#define XPYB_RAWBUF_MAXFREE 64
+
+typedef struct {
+    PyObject_HEAD
+    void *data;
+    Py_ssize_t size;
+    xpybConn *pool;
+} xpybRawbuf;
+
+extern PyTypeObject xpybRawbuf_type;
+
+PyObject *xpybRawbuf_create(void *data, Py_ssize_t size);
+xpybRawbuf *xpybRawbuf_alloc(xpybConn *conn, Py_ssize_t size);
+void xpybRawbuf_clear_pool(xpybConn *conn);
+
+int xpybRawbuf_modinit(PyObject *m);
+
+#endif
@@ -0,0 +1,319 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "event.h"
+#include "error.h"
+#include "extkey.h"
+#include "freelist.h"
+#include "replay.h"
+
+#ifndef XCB_GE_GENERIC
+#define XCB_GE_GENERIC 35
+#endif
+
+/*
+ * Event replay.  Feeds recorded events, in wire layout as buffer(event)
+ * holds them, through the same path wait_for_event() takes, as fast as
+ * possible, and reports the rate per event code.  Each record is turned
+ * back into the malloc'd block libxcb would hand out before timing
+ * starts.  Without a connection the core events and the extensions
+ * named by the caller are decoded, with no server involved.
+ */
+
+typedef struct {
+    xcb_generic_event_t *event;
+    size_t size;
+} xpybReplayRecord;
+
+typedef struct {
+    unsigned long count;
+    double seconds;
+} xpybReplayStat;
+
+/*
+ * Helpers
+ */
+
+/* The offline stand-in for a connection's event table */
+static int
+xpybReplay_load_table(PyObject **table, PyObject *extensions)
+{
+    PyObject *key, *value, *events;
+    Py_ssize_t j = 0;
+    long first_event;
+
+    if (xpybModule_core_events != NULL)
+	xpybResponse_fill_table(table, 128, xpybModule_core_events, 0);
+    if (extensions == NULL || extensions == Py_None)
+	return 0;
+
+    if (!PyDict_Check(extensions)) {
+	PyErr_SetString(PyExc_TypeError, "Extensions must map extension keys to first event codes.");
+	return -1;
+    }
+    while (PyDict_Next(extensions, &j, &key, &value)) {
+	first_event = PyInt_AsLong(value);
+	if (first_event == -1 && PyErr_Occurred())
+	    return -1;
+	events = PyDict_GetItem(xpybModule_ext_events, key);
+	if (events == NULL) {
+	    PyErr_SetString(xpybExcept_ext, "No extension found for that key.");
+	    return -1;
+	}
+	xpybResponse_fill_table(table, 128, events, first_event);
+    }
+    return 0;
+}
+
+/* Builds the block libxcb would return for a record in wire layout */
+static int
+xpybReplay_convert(PyObject *obj, xpybReplayRecord *rec, int offline)
+{
+    const unsigned char *data;
+    Py_ssize_t len, extra = 0;
+
+    if (PyObject_AsReadBuffer(obj, (const void **)&data, &len) < 0)
+	return -1;
+    if (len < 32) {
+	PyErr_SetString(PyExc_ValueError, "Event record shorter than 32 bytes.");
+	return -1;
+    }
+    if (data[0] == 1 || (data[0] == 0 && offline)) {
+	PyErr_SetString(PyExc_ValueError, data[0] ? "Replies cannot be replayed." :
+			"Error records need a connection to be replayed.");
+	return -1;
+    }
+    if ((data[0] & 0x7f) == XCB_GE_GENERIC) {
+	extra = (Py_ssize_t)((const xcb_ge_event_t *)data)->length * 4;
+	if (len < 32 + extra) {
+	    PyErr_SetString(PyExc_ValueError, "Generic event record is truncated.");
+	    return -1;
+	}
+    }
+
+    rec->size = sizeof(xcb_generic_event_t) + extra;
+    rec->event = calloc(1, rec->size);
+    if (rec->event == NULL) {
+	PyErr_NoMemory();
+	return -1;
+    }
+    memcpy(rec->event, data, 32);
+    memcpy(rec->event + 1, data + 32, extra);
+    return 0;
+}
+
+/*
+ * Wraps one record the way wait_for_event() does, or as the
+ * Multiplexer does for errors: ignored ones are skipped, deferred ones
+ * queued, and the rest handed over as exception instances.  Returns a
+ * new reference, None for a skipped record, or NULL on failure.  Events
+ * are wrapped without xpybEvent_create(), so that replayed records do
+ * not count as received: they must not touch the connection's lag
+ * statistics or load extensions in the middle of a timed run.
+ */
+static PyObject *
+xpybReplay_dispatch(xpybConn *conn, PyObject **table, xcb_generic_event_t *e)
+{
+    unsigned char opcode = e->response_type & 0x7f;
+    PyObject *type = (PyObject *)&xpybEvent_type, **entry = table + opcode;
+
+    if (conn != NULL && e->response_type == 0) {
+	if (xpybConn_ignored(conn, (xcb_generic_error_t *)e)) {
+	    free(e);
+	    Py_RETURN_NONE;
+	}
+	if (conn->priv->defer_errors) {
+	    if (xpybConn_defer_error(conn, (xcb_generic_error_t *)e) < 0)
+		return NULL;
+	    Py_RETURN_NONE;
+	}
+	return xpybError_exception(conn, (xcb_generic_error_t *)e);
+    }
+
+    if (conn != NULL)
+	entry = opcode < conn->events_len ? conn->events + opcode : NULL;
+    if (entry != NULL && *entry != NULL) {
+	if (!PyType_Check(*entry))
+	    if (xpybConn_resolve_entry(entry) < 0) {
+		free(e);
+		return NULL;
+	    }
+	type = *entry;
+    }
+    return xpybEvent_wrap(type, conn, e);
+}
+
+/* Difference between two xcb.freelist_stats() results */
+static PyObject *
+xpybReplay_allocations(PyObject *before, PyObject *after)
+{
+    PyObject *result, *name, *a, *b, *value;
+    Py_ssize_t j = 0;
+    long hits, misses;
+
+    result = PyDict_New();
+    if (result == NULL)
+	return NULL;
+
+    while (PyDict_Next(after, &j, &name, &a)) {
+	b = PyDict_GetItem(before, name);
+	if (b == NULL)
+	    continue;
+	hits = PyInt_AsLong(PyDict_GetItemString(a, "hits")) -
+	    PyInt_AsLong(PyDict_GetItemString(b, "hits"));
+	misses = PyInt_AsLong(PyDict_GetItemString(a, "misses")) -
+	    PyInt_AsLong(PyDict_GetItemString(b, "misses"));
+	value = Py_BuildValue("{slsl}", "reused", hits, "allocated", misses);
+	if (value == NULL || PyDict_SetItem(result, name, value) < 0) {
+	    Py_XDECREF(value);
+	    Py_DECREF(result);
+	    return NULL;
+	}
+	Py_DECREF(value);
+    }
+
+    return result;
+}
+
+static PyObject *
+xpybReplay_report(xpybReplayStat *stats, double seconds, PyObject *allocations)
+{
+    PyObject *types, *value, *key;
+    unsigned long total = 0;
+    int i;
+
+    types = PyDict_New();
+    if (types == NULL)
+	return NULL;
+
+    for (i = 0; i < 128; i++) {
+	if (stats[i].count == 0)
+	    continue;
+	total += stats[i].count;
+	value = Py_BuildValue("{sksdsd}", "count", stats[i].count,
+			      "seconds", stats[i].seconds,
+			      "rate", stats[i].seconds > 0 ? stats[i].count / stats[i].seconds : 0.0);
+	key = PyInt_FromLong(i);
+	if (value == NULL || key == NULL || PyDict_SetItem(types, key, value) < 0) {
+	    Py_XDECREF(key);
+	    Py_XDECREF(value);
+	    Py_DECREF(types);
+	    return NULL;
+	}
+	Py_DECREF(key);
+	Py_DECREF(value);
+    }
+
+    return Py_BuildValue("{sksdsdsNsO}", "events", total, "seconds", seconds,
+			 "rate", seconds > 0 ? total / seconds : 0.0,
+			 "types", types, "allocations", allocations);
+}
+
+/*
+ * xcb.replay_events(records, handler=None, repeat=1, conn=None,
+ * extensions=None).  The handler is called with each event; time spent
+ * in it counts towards the event's code, so that handler code can be
+ * measured along with decoding.
+ */
+PyObject *
+xpybReplay_run(PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "records", "handler", "repeat", "conn", "extensions", NULL };
+    PyObject *records, *handler = Py_None, *conn = Py_None, *extensions = NULL;
+    PyObject *seq = NULL, *obj, *ret, *result = NULL, *before = NULL, *after, *allocations;
+    PyObject *table[128];
+    xpybReplayRecord *recs = NULL;
+    xpybReplayStat stats[128];
+    xcb_generic_event_t *e;
+    Py_ssize_t i, n = 0;
+    double start, t, begin;
+    unsigned char opcode;
+    int repeat = 1, r;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|OiOO", kwlist, &records, &handler,
+				     &repeat, &conn, &extensions))
+	return NULL;
+    if (repeat < 0) {
+	PyErr_SetString(PyExc_ValueError, "Repeat count must be zero or positive.");
+	return NULL;
+    }
+    if (conn != Py_None && !PyObject_TypeCheck(conn, &xpybConn_type)) {
+	PyErr_SetString(PyExc_TypeError, "Expected an xcb.Connection or None.");
+	return NULL;
+    }
+    if (conn != Py_None && xpybConn_invalid((xpybConn *)conn))
+	return NULL;
+
+    memset(table, 0, sizeof(table));
+    memset(stats, 0, sizeof(stats));
+    if (conn == Py_None && xpybReplay_load_table(table, extensions) < 0)
+	goto out;
+
+    seq = PySequence_Fast(records, "Records must be a sequence of strings or buffers.");
+    if (seq == NULL)
+	goto out;
+    recs = calloc(PySequence_Fast_GET_SIZE(seq) + 1, sizeof(*recs));
+    if (recs == NULL) {
+	PyErr_NoMemory();
+	goto out;
+    }
+    for (n = 0; n < PySequence_Fast_GET_SIZE(seq); n++)
+	if (xpybReplay_convert(PySequence_Fast_GET_ITEM(seq, n), recs + n, conn == Py_None) < 0)
+	    goto out;
+
+    before = xpybFreelist_stats();
+    if (before == NULL)
+	goto out;
+
+    begin = xpybModule_now();
+    for (r = 0; r < repeat; r++)
+	for (i = 0; i < n; i++) {
+	    start = xpybModule_now();
+	    opcode = recs[i].event->response_type & 0x7f;
+
+	    /* A fresh copy each time, since the dispatch frees it */
+	    e = malloc(recs[i].size);
+	    if (e == NULL) {
+		PyErr_NoMemory();
+		goto out;
+	    }
+	    memcpy(e, recs[i].event, recs[i].size);
+
+	    obj = xpybReplay_dispatch(conn == Py_None ? NULL : (xpybConn *)conn, table, e);
+	    if (obj == NULL)
+		goto out;
+	    if (obj != Py_None && handler != Py_None) {
+		ret = PyObject_CallFunctionObjArgs(handler, obj, NULL);
+		Py_DECREF(obj);
+		if (ret == NULL)
+		    goto out;
+		obj = ret;
+	    }
+	    Py_DECREF(obj);
+
+	    t = xpybModule_now();
+	    stats[opcode].count++;
+	    stats[opcode].seconds += t - start;
+	}
+    t = xpybModule_now() - begin;
+
+    after = xpybFreelist_stats();
+    if (after == NULL)
+	goto out;
+    allocations = xpybReplay_allocations(before, after);
+    Py_DECREF(after);
+    if (allocations == NULL)
+	goto out;
+
+    result = xpybReplay_report(stats, t, allocations);
+    Py_DECREF(allocations);
+out:
+    for (i = 0; recs != NULL && recs[i].event != NULL; i++)
+	free(recs[i].event);
+    free(recs);
+    for (i = 0; i < 128; i++)
+	Py_XDECREF(table[i]);
+    Py_XDECREF(before);
+    Py_XDECREF(seq);
+    return result;
+}
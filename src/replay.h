@@ -0,0 +1,6 @@
+#ifndef XPYB_REPLAY_H
+#define XPYB_REPLAY_H
+
+PyObject *xpybReplay_run(PyObject *args, PyObject *kw);
+
+#endif
@@ -18,21 +18,30 @@
  */
 
 static PyObject *
-xpybReply_getattro(PyObject *self, PyObject *obj)
+xpybReply_get_length(PyObject *self, void *closure)
 {
-    const char *name = PyString_AS_STRING(obj);
-    xcb_generic_reply_t *data;
+    const xcb_generic_reply_t *data;
     Py_ssize_t size;
 
-    if (PyObject_AsReadBuffer(self, (const void **)&data, &size) < 0)
+    if (xpybProtobj_data((xpybProtobj *)self, (const void **)&data, &size) < 0)
 	return NULL;
+    if (size < 8) {
+	PyErr_SetString(xpybExcept_base, "Reply buffer too short.");
+	return NULL;
+    }
 
-    if (strcmp(name, "length") == 0)
-	return Py_BuildValue("I", data->length);
-
-    return xpybReply_type.tp_base->tp_getattro(self, obj);
+    return PyInt_FromSize_t(data->length);
 }
 
+static PyGetSetDef xpybReply_getset[] = {
+    { "length",
+      (getter)xpybReply_get_length,
+      NULL,
+      "Reply length in 4-byte units, beyond the first 32 bytes" },
+
+    { NULL } /* terminator */
+};
+
 
 /*
  * Definition
@@ -42,10 +51,10 @@ PyTypeObject xpybReply_type = {
     PyObject_HEAD_INIT(NULL)
     .tp_name = "xcb.Reply",
     .tp_basicsize = sizeof(xpybReply),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic reply object",
     .tp_base = &xpybResponse_type,
-    .tp_getattro = xpybReply_getattro
+    .tp_getset = xpybReply_getset
 };
 
 
@@ -52,7 +52,7 @@ PyTypeObject xpybRequest_type = {
     .tp_name = "xcb.Request",
     .tp_basicsize = sizeof(xpybRequest),
     .tp_init = (initproc)xpybRequest_init,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic request object",
     .tp_base = &xpybProtobj_type,
 };
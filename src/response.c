@@ -6,6 +6,27 @@
  * Helpers
  */
 
+/*
+ * Fills an event or error table, indexed by response code, from the dict
+ * of a generated module that maps numbers to classes.  The numbers count
+ * from base; codes outside the table are skipped.
+ */
+void
+xpybResponse_fill_table(PyObject **table, long len, PyObject *types, long base)
+{
+    PyObject *num, *type;
+    Py_ssize_t j = 0;
+    long code;
+
+    while (PyDict_Next(types, &j, &num, &type)) {
+	code = base + PyInt_AS_LONG(num);
+	if (code < 0 || code >= len)
+	    continue;
+	Py_INCREF(type);
+	Py_XDECREF(table[code]);
+	table[code] = type;
+    }
+}
 
 /*
  * Infrastructure
@@ -17,23 +38,51 @@
  */
 
 static PyObject *
-xpybResponse_getattro(PyObject *self, PyObject *obj)
+xpybResponse_get_response_type(PyObject *self, void *closure)
 {
-    const char *name = PyString_AS_STRING(obj);
     const xcb_generic_event_t *data;
     Py_ssize_t size;
 
-    if (PyObject_AsReadBuffer(self, (const void **)&data, &size) < 0)
+    if (xpybProtobj_data((xpybProtobj *)self, (const void **)&data, &size) < 0)
 	return NULL;
+    if (size < 1) {
+	PyErr_SetString(xpybExcept_base, "Response buffer too short.");
+	return NULL;
+    }
 
-    if (strcmp(name, "response_type") == 0)
-	return Py_BuildValue("B", data->response_type);
-    if (strcmp(name, "sequence") == 0)
-	return Py_BuildValue("H", data->sequence);
+    return PyInt_FromLong(data->response_type);
+}
 
-    return xpybResponse_type.tp_base->tp_getattro(self, obj);
+static PyObject *
+xpybResponse_get_sequence(PyObject *self, void *closure)
+{
+    const xcb_generic_event_t *data;
+    Py_ssize_t size;
+
+    if (xpybProtobj_data((xpybProtobj *)self, (const void **)&data, &size) < 0)
+	return NULL;
+    if (size < 4) {
+	PyErr_SetString(xpybExcept_base, "Response buffer too short.");
+	return NULL;
+    }
+
+    return PyInt_FromLong(data->sequence);
 }
 
+static PyGetSetDef xpybResponse_getset[] = {
+    { "response_type",
+      (getter)xpybResponse_get_response_type,
+      NULL,
+      "Response type code" },
+
+    { "sequence",
+      (getter)xpybResponse_get_sequence,
+      NULL,
+      "Sequence number" },
+
+    { NULL } /* terminator */
+};
+
 
 /*
  * Definition
@@ -43,10 +92,10 @@ PyTypeObject xpybResponse_type = {
     PyObject_HEAD_INIT(NULL)
     .tp_name = "xcb.Response",
     .tp_basicsize = sizeof(xpybResponse),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic response object",
     .tp_base = &xpybProtobj_type,
-    .tp_getattro = xpybResponse_getattro
+    .tp_getset = xpybResponse_getset
 };
 
 
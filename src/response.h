@@ -9,6 +9,8 @@ typedef struct {
 
 extern PyTypeObject xpybResponse_type;
 
+void xpybResponse_fill_table(PyObject **table, long len, PyObject *types, long base);
+
 int xpybResponse_modinit(PyObject *m);
 
 #endif
@@ -0,0 +1,699 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "ext.h"
+#include "error.h"
+#include "event.h"
+#include "protobj.h"
+#include "rawbuf.h"
+#include "ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Event ring in POSIX shared memory.  The process owning the connection
+ * writes raw events into a fixed array of slots; any number of reader
+ * processes follow at their own pace and decode the bytes with the
+ * generated event classes.  There is one writer, so a slot is guarded by
+ * its sequence number alone, seqlock style: it is zeroed while the slot
+ * is rewritten, and a reader that sees it change while copying knows
+ * the event was overwritten.  Readers that fall more than a ring behind
+ * skip ahead and count the events they missed.
+ */
+
+#ifndef XCB_GE_GENERIC
+#define XCB_GE_GENERIC 35
+#endif
+
+/* Offset of the window an event was selected on, by core event code */
+static const unsigned char xpybRing_window_offset[35] = {
+    [2] = 12, [3] = 12, [4] = 12, [5] = 12, [6] = 12, [7] = 12, [8] = 12,
+    [9] = 4, [10] = 4, [12] = 4, [13] = 4, [14] = 4, [15] = 4, [16] = 4,
+    [17] = 4, [18] = 4, [19] = 4, [20] = 4, [21] = 4, [22] = 4, [23] = 4,
+    [24] = 4, [25] = 4, [26] = 4, [27] = 4, [28] = 4, [29] = 8, [30] = 8,
+    [31] = 8, [32] = 4, [33] = 4,
+};
+
+/*
+ * Helpers
+ */
+
+static xpybRingSlot *
+xpybRing_slot(xpybRing *self, uint64_t seq)
+{
+    return (xpybRingSlot *)((char *)(self->hdr + 1) + (seq % self->hdr->slots) * self->stride);
+}
+
+static int
+xpybRing_check(xpybRing *self, int owner)
+{
+    if (self->hdr == NULL) {
+	PyErr_SetString(xpybExcept_base, "Ring is not attached.");
+	return -1;
+    }
+    if (owner && !self->owner) {
+	PyErr_SetString(xpybExcept_base, "Only the process that created the ring can write to it.");
+	return -1;
+    }
+    return 0;
+}
+
+static uint32_t
+xpybRing_window(const unsigned char *data)
+{
+    unsigned char opcode = data[0] & 0x7f;
+    uint32_t window = 0;
+
+    if (opcode < sizeof(xpybRing_window_offset) && xpybRing_window_offset[opcode])
+	memcpy(&window, data + xpybRing_window_offset[opcode], sizeof(window));
+    return window;
+}
+
+/* Copies one event in wire layout into the next slot */
+static void
+xpybRing_write(xpybRing *self, const void *data, Py_ssize_t size)
+{
+    xpybRingHeader *hdr = self->hdr;
+    uint64_t seq = hdr->write_seq + 1;
+    xpybRingSlot *slot;
+
+    if (size > hdr->slot_size || size < 32) {
+	self->dropped++;
+	return;
+    }
+
+    slot = xpybRing_slot(self, seq);
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->window = xpybRing_window(data);
+    slot->size = size;
+    memcpy(slot + 1, data, size);
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->write_seq, seq, __ATOMIC_RELEASE);
+    self->published++;
+}
+
+/* Publishes the event bases of the extensions loaded on the connection */
+static void
+xpybRing_sync_exts(xpybRing *self, xpybConn *conn)
+{
+    xpybRingHeader *hdr = self->hdr;
+    PyObject *key, *value;
+    xpybExt *ext;
+    Py_ssize_t i = 0;
+    uint32_t n = 0, gen;
+
+    if (PyDict_Size(conn->extcache) == self->ext_synced)
+	return;
+
+    /* Odd while the table is rewritten, as the slot sequence is zero */
+    gen = hdr->ext_gen;
+    __atomic_store_n(&hdr->ext_gen, gen + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    while (PyDict_Next(conn->extcache, &i, &key, &value)) {
+	ext = (xpybExt *)value;
+	if (!ext->present || n == XPYB_RING_EXTS)
+	    continue;
+	strncpy(hdr->ext[n].name, PyString_AS_STRING(((xpybExtkey *)key)->name), XPYB_RING_EXTNAME - 1);
+	hdr->ext[n].name[XPYB_RING_EXTNAME - 1] = '\0';
+	hdr->ext[n].first_event = ext->first_event;
+	n++;
+    }
+
+    hdr->ext_count = n;
+    __atomic_store_n(&hdr->ext_gen, gen + 2, __ATOMIC_RELEASE);
+    self->ext_synced = PyDict_Size(conn->extcache);
+}
+
+/*
+ * Rebuilds the reader's event table from the core events and the
+ * extensions the owner published, matched to registered extensions by
+ * name.  The table is copied out first and the copy retried if the
+ * owner was rewriting it; an owner that never finishes leaves the old
+ * table in place until the next call.
+ */
+static void
+xpybRing_load_table(xpybRing *self)
+{
+    xpybRingHeader *hdr = self->hdr;
+    xpybRingExt exts[XPYB_RING_EXTS];
+    PyObject *key, *events;
+    uint32_t gen, n = 0, i;
+    Py_ssize_t j;
+    int tries;
+
+    for (tries = 0; ; tries++) {
+	if (tries == 1000)
+	    return;
+	gen = __atomic_load_n(&hdr->ext_gen, __ATOMIC_ACQUIRE);
+	if (gen & 1)
+	    continue;
+	if (gen == self->table_gen)
+	    return;
+	n = hdr->ext_count < XPYB_RING_EXTS ? hdr->ext_count : XPYB_RING_EXTS;
+	memcpy(exts, hdr->ext, n * sizeof(*exts));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&hdr->ext_gen, __ATOMIC_RELAXED) == gen)
+	    break;
+    }
+
+    for (i = 0; i < 128; i++)
+	Py_CLEAR(self->events[i]);
+    if (xpybModule_core_events != NULL)
+	xpybResponse_fill_table(self->events, 128, xpybModule_core_events, 0);
+
+    for (i = 0; i < n; i++) {
+	exts[i].name[XPYB_RING_EXTNAME - 1] = '\0';
+	j = 0;
+	while (PyDict_Next(xpybModule_ext_events, &j, &key, &events))
+	    if (strncmp(PyString_AS_STRING(((xpybExtkey *)key)->name), exts[i].name,
+			XPYB_RING_EXTNAME) == 0)
+		xpybResponse_fill_table(self->events, 128, events, exts[i].first_event);
+    }
+
+    self->table_gen = gen;
+}
+
+/*
+ * Copies the next event into buf.  Returns 1 for an event, 0 when the
+ * reader has caught up with the writer.
+ */
+static int
+xpybRing_read_one(xpybRing *self, void *buf, uint32_t *size, uint32_t *window)
+{
+    xpybRingHeader *hdr = self->hdr;
+    xpybRingSlot *slot;
+    uint64_t write_seq, seq;
+
+    for (;;) {
+	write_seq = __atomic_load_n(&hdr->write_seq, __ATOMIC_ACQUIRE);
+	if (self->next > write_seq)
+	    return 0;
+	if (write_seq - self->next >= hdr->slots) {
+	    self->lost += write_seq - hdr->slots + 1 - self->next;
+	    self->next = write_seq - hdr->slots + 1;
+	}
+
+	slot = xpybRing_slot(self, self->next);
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	if (seq == self->next) {
+	    *size = slot->size;
+	    *window = slot->window;
+	    if (*size <= hdr->slot_size)
+		memcpy(buf, slot + 1, *size);
+	    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq && *size <= hdr->slot_size) {
+		self->next++;
+		return 1;
+	    }
+	}
+
+	/* Overwritten before or while it was copied */
+	self->lost++;
+	self->next++;
+    }
+}
+
+static int
+xpybRing_wanted(xpybRing *self, const unsigned char *data, uint32_t window)
+{
+    unsigned char opcode = data[0] & 0x7f;
+    Py_ssize_t lo = 0, hi = self->windows_len, mid;
+
+    if (self->filter_types && !(self->types[opcode >> 3] & (1 << (opcode & 7))))
+	return 0;
+    if (self->windows == NULL)
+	return 1;
+
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (self->windows[mid] < window)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo < self->windows_len && self->windows[lo] == window;
+}
+
+static PyObject *
+xpybRing_decode(xpybRing *self, const void *data, uint32_t size)
+{
+    unsigned char opcode = ((const unsigned char *)data)[0] & 0x7f;
+    PyObject *type = (PyObject *)&xpybEvent_type, *shim, *event;
+    void *copy;
+
+    xpybRing_load_table(self);
+    if (self->events[opcode] != NULL) {
+	if (!PyType_Check(self->events[opcode]))
+	    if (xpybConn_resolve_entry(self->events + opcode) < 0)
+		return NULL;
+	type = self->events[opcode];
+    }
+
+    copy = malloc(size);
+    if (copy == NULL)
+	return PyErr_NoMemory();
+    memcpy(copy, data, size);
+
+    shim = xpybRawbuf_create(copy, size);
+    if (shim == NULL) {
+	free(copy);
+	return NULL;
+    }
+
+    event = PyObject_CallFunctionObjArgs(type, shim, NULL);
+    Py_DECREF(shim);
+    return event;
+}
+
+static int
+xpybRing_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+/*
+ * Infrastructure
+ */
+
+static int
+xpybRing_init(xpybRing *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "name", "create", "slots", "slot_size", "replace", NULL };
+    PyObject *name, *create = Py_False, *replace = Py_False;
+    unsigned int slots = XPYB_RING_SLOTS, slot_size = XPYB_RING_SLOT_SIZE;
+    xpybRingHeader *hdr;
+    struct stat st;
+    size_t size;
+    int fd, owner, replacing;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "S|OIIO", kwlist,
+				     &name, &create, &slots, &slot_size, &replace))
+	return -1;
+    if (self->hdr != NULL) {
+	PyErr_SetString(xpybExcept_base, "Ring is already attached.");
+	return -1;
+    }
+
+    owner = PyObject_IsTrue(create);
+    if (owner < 0)
+	return -1;
+    replacing = PyObject_IsTrue(replace);
+    if (replacing < 0)
+	return -1;
+    if (owner && (slots < 1 || slots > (1 << 24) || slot_size < 32 || slot_size > 65536)) {
+	PyErr_SetString(PyExc_ValueError, "Slots must be between 1 and 2**24 and slot size between 32 and 65536.");
+	return -1;
+    }
+
+    /*
+     * A new ring never reuses an existing object: readers still attached
+     * to an old one would fault if it shrank under them.  An existing name
+     * is an error unless the caller asked to replace it; readers of the
+     * old ring keep their mapping but see no new events.
+     */
+    if (owner && replacing)
+	shm_unlink(PyString_AS_STRING(name));
+    fd = shm_open(PyString_AS_STRING(name), owner ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY, 0600);
+    if (fd < 0) {
+	PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyString_AS_STRING(name));
+	return -1;
+    }
+
+    if (owner) {
+	self->stride = sizeof(xpybRingSlot) + ((slot_size + 7) & ~7);
+	size = sizeof(xpybRingHeader) + slots * self->stride;
+	if (ftruncate(fd, size) < 0)
+	    goto err;
+    }
+    else {
+	if (fstat(fd, &st) < 0)
+	    goto err;
+	size = st.st_size;
+    }
+
+    hdr = mmap(NULL, size, owner ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+	goto err;
+    close(fd);
+
+    if (owner) {
+	hdr->version = XPYB_RING_VERSION;
+	hdr->slots = slots;
+	hdr->slot_size = slot_size;
+	__atomic_store_n(&hdr->magic, XPYB_RING_MAGIC, __ATOMIC_RELEASE);
+    }
+    else if (size < sizeof(xpybRingHeader) ||
+	     __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != XPYB_RING_MAGIC ||
+	     hdr->version != XPYB_RING_VERSION ||
+	     size < sizeof(xpybRingHeader) + (size_t)hdr->slots *
+	     (sizeof(xpybRingSlot) + ((hdr->slot_size + 7) & ~7))) {
+	munmap(hdr, size);
+	PyErr_SetString(xpybExcept_base, "Shared memory object is not an event ring.");
+	return -1;
+    }
+
+    self->hdr = hdr;
+    self->map_size = size;
+    self->stride = sizeof(xpybRingSlot) + ((hdr->slot_size + 7) & ~7);
+    self->owner = owner;
+    self->next = __atomic_load_n(&hdr->write_seq, __ATOMIC_ACQUIRE) + 1;
+    self->ext_synced = -1;
+    self->table_gen = 1;	/* odd, so never current */
+    Py_INCREF(self->name = name);
+    return 0;
+err:
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyString_AS_STRING(name));
+    close(fd);
+    return -1;
+}
+
+static void
+xpybRing_dealloc(xpybRing *self)
+{
+    int i;
+
+    if (self->hdr != NULL)
+	munmap(self->hdr, self->map_size);
+    for (i = 0; i < 128; i++)
+	Py_CLEAR(self->events[i]);
+    free(self->windows);
+    Py_CLEAR(self->name);
+    self->ob_type->tp_free((PyObject *)self);
+}
+
+
+/*
+ * Members
+ */
+
+static PyMemberDef xpybRing_members[] = {
+    { "name",
+      T_OBJECT,
+      offsetof(xpybRing, name),
+      READONLY,
+      "Name of the shared memory object." },
+
+    { "published",
+      T_ULONG,
+      offsetof(xpybRing, published),
+      READONLY,
+      "Number of events written by this process." },
+
+    { "dropped",
+      T_ULONG,
+      offsetof(xpybRing, dropped),
+      READONLY,
+      "Number of events too large for a slot, which were not written." },
+
+    { "lost",
+      T_ULONG,
+      offsetof(xpybRing, lost),
+      READONLY,
+      "Number of events overwritten before this reader got to them." },
+
+    { NULL } /* terminator */
+};
+
+
+/*
+ * Methods
+ */
+
+static PyObject *
+xpybRing_publish(xpybRing *self, PyObject *args)
+{
+    xpybProtobj *event;
+    const void *data;
+    Py_ssize_t size;
+
+    if (!PyArg_ParseTuple(args, "O!", &xpybEvent_type, &event))
+	return NULL;
+    if (xpybRing_check(self, 1) < 0)
+	return NULL;
+    if (xpybProtobj_data(event, &data, &size) < 0)
+	return NULL;
+
+    xpybRing_write(self, data, size);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+xpybRing_forward(xpybRing *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "conn", "timeout", NULL };
+    unsigned char buf[65536 + 32];
+    xcb_generic_event_t *data;
+    xpybConn *conn;
+    PyObject *timeout = NULL;
+    Py_ssize_t count = 0, size;
+    double deadline;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O!|O", kwlist, &xpybConn_type, &conn, &timeout))
+	return NULL;
+
+    /* Unlike the other waits, the default is not to wait at all */
+    if (timeout == NULL)
+	deadline = xpybModule_now();
+    else if (xpybConn_deadline(timeout, &deadline) < 0)
+	return NULL;
+
+    if (xpybRing_check(self, 1) < 0 || xpybConn_invalid(conn))
+	return NULL;
+    if (xpybConn_load_all(conn) < 0)
+	return NULL;
+    xpybRing_sync_exts(self, conn);
+
+    for (;;) {
+	if (count == 0 && deadline < 0) {
+	    xpybConn_flush_for_wait(conn);
+	    data = xcb_wait_for_event(conn->conn);
+	}
+	else
+	    data = xcb_poll_for_event(conn->conn);
+
+	if (data == NULL) {
+	    if (xpybConn_invalid(conn))
+		return NULL;
+	    if (count > 0 || xpybModule_now() >= deadline)
+		break;
+	    xcb_flush(conn->conn);
+	    if (xpybConn_wait_readable(conn, deadline) < 0) {
+		if (!PyErr_ExceptionMatches(xpybExcept_timeout))
+		    return NULL;
+		PyErr_Clear();
+		break;
+	    }
+	    continue;
+	}
+
+	if (data->response_type != 0) {
+	    /* Back to wire layout, as in xpybEvent_create() */
+	    size = 32;
+	    if ((data->response_type & 0x7f) == XCB_GE_GENERIC)
+		size += (Py_ssize_t)((xcb_ge_event_t *)data)->length * 4;
+	    if (size <= self->hdr->slot_size) {
+		memcpy(buf, data, 32);
+		memcpy(buf + 32, data + 1, size - 32);
+		xpybRing_write(self, buf, size);
+	    }
+	    else
+		self->dropped++;
+	    free(data);
+	    count++;
+	    continue;
+	}
+
+	if (xpybConn_ignored(conn, (xcb_generic_error_t *)data)) {
+	    free(data);
+	    continue;
+	}
+	if (!conn->priv->defer_errors) {
+	    xpybError_set(conn, (xcb_generic_error_t *)data);
+	    return NULL;
+	}
+	if (xpybConn_defer_error(conn, (xcb_generic_error_t *)data) < 0)
+	    return NULL;
+    }
+
+    return PyInt_FromSsize_t(count);
+}
+
+static PyObject *
+xpybRing_read(xpybRing *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "timeout", NULL };
+    unsigned char buf[65536];
+    struct timespec nap = { 0, 500000 };
+    PyObject *timeout = NULL;
+    uint32_t size, window;
+    double deadline;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|O", kwlist, &timeout))
+	return NULL;
+    if (xpybConn_deadline(timeout, &deadline) < 0)
+	return NULL;
+    if (xpybRing_check(self, 0) < 0)
+	return NULL;
+
+    for (;;) {
+	while (xpybRing_read_one(self, buf, &size, &window))
+	    if (xpybRing_wanted(self, buf, window))
+		return xpybRing_decode(self, buf, size);
+
+	if (deadline >= 0 && xpybModule_now() >= deadline)
+	    Py_RETURN_NONE;
+
+	/* There is no wakeup across processes; poll at a fine interval */
+	Py_BEGIN_ALLOW_THREADS
+	nanosleep(&nap, NULL);
+	Py_END_ALLOW_THREADS
+	if (PyErr_CheckSignals() < 0)
+	    return NULL;
+    }
+}
+
+static PyObject *
+xpybRing_subscribe(xpybRing *self, PyObject *args, PyObject *kw)
+{
+    static char *kwlist[] = { "types", "windows", NULL };
+    PyObject *types = Py_None, *windows = Py_None, *seq = NULL;
+    unsigned char mask[16];
+    uint32_t *ids = NULL;
+    Py_ssize_t i, n = 0;
+    long code;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OO", kwlist, &types, &windows))
+	return NULL;
+
+    memset(mask, 0, sizeof(mask));
+    if (types != Py_None) {
+	seq = PySequence_Fast(types, "Types must be a sequence of event codes.");
+	if (seq == NULL)
+	    return NULL;
+	for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+	    code = PyInt_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+	    if (code == -1 && PyErr_Occurred())
+		goto err;
+	    if (code < 0 || code > 127) {
+		PyErr_SetString(PyExc_ValueError, "Event codes must be between 0 and 127.");
+		goto err;
+	    }
+	    mask[code >> 3] |= 1 << (code & 7);
+	}
+	Py_CLEAR(seq);
+    }
+
+    if (windows != Py_None) {
+	seq = PySequence_Fast(windows, "Windows must be a sequence of window ids.");
+	if (seq == NULL)
+	    return NULL;
+	n = PySequence_Fast_GET_SIZE(seq);
+	ids = malloc((n ? n : 1) * sizeof(*ids));
+	if (ids == NULL) {
+	    PyErr_NoMemory();
+	    goto err;
+	}
+	for (i = 0; i < n; i++) {
+	    ids[i] = PyInt_AsUnsignedLongMask(PySequence_Fast_GET_ITEM(seq, i));
+	    if (PyErr_Occurred())
+		goto err;
+	}
+	qsort(ids, n, sizeof(*ids), xpybRing_compare);
+	Py_CLEAR(seq);
+    }
+
+    self->filter_types = types != Py_None;
+    memcpy(self->types, mask, sizeof(mask));
+    free(self->windows);
+    self->windows = ids;
+    self->windows_len = n;
+    Py_RETURN_NONE;
+err:
+    free(ids);
+    Py_XDECREF(seq);
+    return NULL;
+}
+
+static PyObject *
+xpybRing_unlink(xpybRing *self, PyObject *args)
+{
+    if (xpybRing_check(self, 1) < 0)
+	return NULL;
+
+    if (shm_unlink(PyString_AS_STRING(self->name)) < 0)
+	return PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyString_AS_STRING(self->name));
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef xpybRing_methods[] = {
+    { "publish",
+      (PyCFunction)xpybRing_publish,
+      METH_VARARGS,
+      "Writes an event object into the ring." },
+
+    { "forward",
+      (PyCFunction)xpybRing_forward,
+      METH_VARARGS | METH_KEYWORDS,
+      "Moves the queued events of a connection into the ring." },
+
+    { "read",
+      (PyCFunction)xpybRing_read,
+      METH_VARARGS | METH_KEYWORDS,
+      "Returns the next subscribed event, waiting for up to timeout seconds." },
+
+    { "subscribe",
+      (PyCFunction)xpybRing_subscribe,
+      METH_VARARGS | METH_KEYWORDS,
+      "Limits read() to the given event codes and windows." },
+
+    { "unlink",
+      (PyCFunction)xpybRing_unlink,
+      METH_NOARGS,
+      "Removes the ring's name; attached processes keep their mapping." },
+
+    { NULL } /* terminator */
+};
+
+
+/*
+ * Definition
+ */
+
+PyTypeObject xpybRing_type = {
+    PyObject_HEAD_INIT(NULL)
+    .tp_name = "xcb.EventRing",
+    .tp_basicsize = sizeof(xpybRing),
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)xpybRing_init,
+    .tp_dealloc = (destructor)xpybRing_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "XCB event ring shared between processes",
+    .tp_methods = xpybRing_methods,
+    .tp_members = xpybRing_members
+};
+
+
+/*
+ * Module init
+ */
+int xpybRing_modinit(PyObject *m)
+{
+    if (PyType_Ready(&xpybRing_type) < 0)
+        return -1;
+    Py_INCREF(&xpybRing_type);
+    if (PyModule_AddObject(m, "EventRing", (PyObject *)&xpybRing_type) < 0)
+	return -1;
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef XPYB_RING_H
+#define XPYB_RING_H
+
+#include <stdint.h>
+#include "conn.h"
+
+#define XPYB_RING_MAGIC 0x52595058
+#define XPYB_RING_VERSION 1
+
+/* Extensions whose event base the owner publishes for the readers */
+#define XPYB_RING_EXTS 64
+#define XPYB_RING_EXTNAME 40
+
+/* Default geometry of a new ring */
+#define XPYB_RING_SLOTS 4096
+#define XPYB_RING_SLOT_SIZE 256
+
+typedef struct {
+    char name[XPYB_RING_EXTNAME];
+    uint32_t first_event;
+    uint32_t pad;
+} xpybRingExt;
+
+/*
+ * Shared layout: this header, then slots of slot header plus data.  The
+ * extension table is guarded by ext_gen, which is odd while the owner
+ * rewrites it.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slot_size;
+    uint64_t write_seq;
+    uint32_t ext_gen;
+    uint32_t ext_count;
+    xpybRingExt ext[XPYB_RING_EXTS];
+} xpybRingHeader;
+
+typedef struct {
+    uint64_t seq;
+    uint32_t window;
+    uint32_t size;
+} xpybRingSlot;
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *name;
+    int owner;
+    xpybRingHeader *hdr;
+    size_t map_size;
+    size_t stride;
+    uint64_t next;
+    unsigned long published;
+    unsigned long dropped;
+    unsigned long lost;
+    Py_ssize_t ext_synced;
+    uint32_t table_gen;
+    PyObject *events[128];
+    int filter_types;
+    unsigned char types[16];
+    uint32_t *windows;
+    Py_ssize_t windows_len;
+} xpybRing;
+
+extern PyTypeObject xpybRing_type;
+
+int xpybRing_modinit(PyObject *m);
+
+#endif
@@ -0,0 +1,170 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "cookie.h"
+#include "rtt.h"
+
+#include <frameobject.h>
+
+/*
+ * Round-trip analyzer.  Looks for a request whose reply is waited for
+ * before any other request was sent, followed by more requests once the
+ * reply is in.  Those later requests could have been sent before waiting,
+ * sharing one round trip.  Findings are kept per generated request method
+ * with the time spent blocked and the call sites involved.
+ */
+
+/*
+ * Helpers
+ */
+
+static void
+xpybRtt_record(xpybConn *conn, PyObject *candidate)
+{
+    PyObject *trace, *name, *site, *entry, *sites, *count, *obj;
+    double blocked;
+
+    trace = PyTuple_GET_ITEM(candidate, 0);
+    blocked = PyFloat_AS_DOUBLE(PyTuple_GET_ITEM(candidate, 1));
+    name = PyTuple_GET_ITEM(trace, 0);
+    site = PyTuple_GET_ITEM(trace, 1);
+
+    entry = PyDict_GetItem(conn->priv->rtt_stats, name);
+    if (entry == NULL) {
+	entry = Py_BuildValue("{sisds{}}", "count", 0, "blocked", 0.0, "sites");
+	if (entry == NULL || PyDict_SetItem(conn->priv->rtt_stats, name, entry) < 0) {
+	    Py_XDECREF(entry);
+	    return;
+	}
+	Py_DECREF(entry);
+    }
+
+    count = PyDict_GetItemString(entry, "count");
+    obj = PyInt_FromLong(PyInt_AS_LONG(count) + 1);
+    if (obj == NULL || PyDict_SetItemString(entry, "count", obj) < 0)
+	goto out;
+    Py_DECREF(obj);
+
+    obj = PyFloat_FromDouble(PyFloat_AS_DOUBLE(PyDict_GetItemString(entry, "blocked")) + blocked);
+    if (obj == NULL || PyDict_SetItemString(entry, "blocked", obj) < 0)
+	goto out;
+    Py_DECREF(obj);
+
+    sites = PyDict_GetItemString(entry, "sites");
+    count = PyDict_GetItem(sites, site);
+    obj = PyInt_FromLong(count ? PyInt_AS_LONG(count) + 1 : 1);
+    if (obj == NULL || PyDict_SetItem(sites, site, obj) < 0)
+	goto out;
+out:
+    Py_XDECREF(obj);
+}
+
+/*
+ * Called for every request sent while the analyzer is on.  Confirms a
+ * waiting candidate, and tags reply-bearing cookies with the generated
+ * method that sent them and the caller of that method.
+ */
+void
+xpybRtt_sent(xpybConn *conn, xpybCookie *cookie)
+{
+    PyFrameObject *frame = PyEval_GetFrame(), *caller;
+
+    conn->priv->rtt_sent++;
+
+    if (conn->priv->rtt_candidate != NULL) {
+	xpybRtt_record(conn, conn->priv->rtt_candidate);
+	Py_CLEAR(conn->priv->rtt_candidate);
+	PyErr_Clear();
+    }
+
+    if (cookie->request->is_void || frame == NULL)
+	return;
+
+    caller = frame->f_back ? frame->f_back : frame;
+    cookie->rtt_trace = Py_BuildValue("(O(Oi))", frame->f_code->co_name,
+				      caller->f_code->co_filename,
+				      PyFrame_GetLineNumber(caller));
+    cookie->rtt_index = conn->priv->rtt_sent;
+    PyErr_Clear();
+}
+
+/*
+ * Called after blocking for a reply.  If nothing was sent since the
+ * request went out, and no other reply was waited for since then (which
+ * would make it the tail of a pipelined batch), the wait becomes a
+ * candidate, counted once another request follows.
+ */
+void
+xpybRtt_replied(xpybConn *conn, xpybCookie *cookie, double blocked)
+{
+    unsigned long waited = conn->priv->rtt_waited;
+
+    conn->priv->rtt_waited = conn->priv->rtt_sent;
+    if (cookie->rtt_trace == NULL || cookie->rtt_index != conn->priv->rtt_sent ||
+	waited >= cookie->rtt_index)
+	return;
+
+    Py_CLEAR(conn->priv->rtt_candidate);
+    conn->priv->rtt_candidate = Py_BuildValue("(Od)", cookie->rtt_trace, blocked);
+    PyErr_Clear();
+}
+
+/*
+ * Like phase timing, turning the analyzer on starts from empty findings
+ * and turning it off keeps them for the report.
+ */
+int
+xpybRtt_enable(xpybConn *conn, int enabled)
+{
+    PyObject *stats;
+
+    Py_CLEAR(conn->priv->rtt_candidate);
+    conn->priv->rtt_analyze = 0;
+    if (!enabled)
+	return 0;
+
+    stats = PyDict_New();
+    if (stats == NULL)
+	return -1;
+    Py_XDECREF(conn->priv->rtt_stats);
+    conn->priv->rtt_stats = stats;
+    conn->priv->rtt_analyze = 1;
+    return 0;
+}
+
+/*
+ * Returns a copy of the findings down to the sites dictionaries, so the
+ * caller cannot change the counts the analyzer keeps adding to.
+ */
+PyObject *
+xpybRtt_report(xpybConn *conn)
+{
+    PyObject *result, *name, *entry, *copy, *sites;
+    Py_ssize_t i = 0;
+
+    result = PyDict_New();
+    if (result == NULL || conn->priv->rtt_stats == NULL)
+	return result;
+
+    while (PyDict_Next(conn->priv->rtt_stats, &i, &name, &entry)) {
+	sites = PyDict_Copy(PyDict_GetItemString(entry, "sites"));
+	if (sites == NULL)
+	    goto err;
+	copy = Py_BuildValue("{sOsOsN}",
+			     "count", PyDict_GetItemString(entry, "count"),
+			     "blocked", PyDict_GetItemString(entry, "blocked"),
+			     "sites", sites);
+	if (copy == NULL)
+	    goto err;
+	if (PyDict_SetItem(result, name, copy) < 0) {
+	    Py_DECREF(copy);
+	    goto err;
+	}
+	Py_DECREF(copy);
+    }
+
+    return result;
+err:
+    Py_DECREF(result);
+    return NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef XPYB_RTT_H
+#define XPYB_RTT_H
+
+#include "conn.h"
+#include "cookie.h"
+
+void xpybRtt_sent(xpybConn *conn, xpybCookie *cookie);
+void xpybRtt_replied(xpybConn *conn, xpybCookie *cookie, double blocked);
+
+int xpybRtt_enable(xpybConn *conn, int enabled);
+PyObject *xpybRtt_report(xpybConn *conn);
+
+#endif
@@ -0,0 +1,378 @@
+#include "module.h"
+#include "except.h"
+#include "conn.h"
+#include "list.h"
+#include "setupidx.h"
+
+/*
+ * Helpers
+ */
+
+/* Size of a VISUALTYPE and a FORMAT on the wire */
+#define XPYB_VISUALTYPE_SIZE 24
+#define XPYB_FORMAT_SIZE 8
+
+static Py_ssize_t
+xpybSetupidx_offset(xpybSetupidx *self, const void *p)
+{
+    return (const char *)p - (const char *)self->setup;
+}
+
+static int
+xpybSetupidx_put(PyObject *dict, PyObject *key, PyObject *value)
+{
+    int rc;
+
+    if (key == NULL || value == NULL)
+	rc = -1;
+    else
+	rc = PyDict_SetItem(dict, key, value);
+
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    return rc;
+}
+
+/*
+ * Walks the connection setup once, recording the offset of every screen,
+ * depth, visual and pixmap format so lookups need not decode anything.
+ */
+static int
+xpybSetupidx_build(xpybSetupidx *self)
+{
+    xcb_screen_iterator_t screen;
+    xcb_depth_iterator_t depth;
+    xcb_visualtype_iterator_t visual;
+    xcb_format_iterator_t format;
+    PyObject *obj;
+    int i;
+
+    format = xcb_setup_pixmap_formats_iterator(self->setup);
+    for (; format.rem; xcb_format_next(&format))
+	if (xpybSetupidx_put(self->formats, PyInt_FromLong(format.data->depth),
+			     PyInt_FromSsize_t(xpybSetupidx_offset(self, format.data))) < 0)
+	    return -1;
+
+    screen = xcb_setup_roots_iterator(self->setup);
+    for (i = 0; screen.rem; xcb_screen_next(&screen), i++) {
+	obj = PyInt_FromSsize_t(xpybSetupidx_offset(self, screen.data));
+	if (obj == NULL || PyList_Append(self->screens, obj) < 0) {
+	    Py_XDECREF(obj);
+	    return -1;
+	}
+	Py_DECREF(obj);
+
+	depth = xcb_screen_allowed_depths_iterator(screen.data);
+	for (; depth.rem; xcb_depth_next(&depth)) {
+	    visual = xcb_depth_visuals_iterator(depth.data);
+	    if (xpybSetupidx_put(self->depths,
+				 Py_BuildValue("(ii)", i, depth.data->depth),
+				 Py_BuildValue("(ni)", xpybSetupidx_offset(self, visual.data),
+					       visual.rem)) < 0)
+		return -1;
+
+	    for (; visual.rem; xcb_visualtype_next(&visual))
+		if (xpybSetupidx_put(self->visuals,
+				     PyInt_FromLong(visual.data->visual_id),
+				     Py_BuildValue("(iin)", i, depth.data->depth,
+						   xpybSetupidx_offset(self, visual.data))) < 0)
+		    return -1;
+	}
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the generated class with the given name from the module that
+ * defines the Setup structure, caching it for later lookups.
+ */
+static PyObject *
+xpybSetupidx_type_of(xpybSetupidx *self, const char *name)
+{
+    PyObject *type, *modname, *mod;
+
+    type = PyDict_GetItemString(self->types, name);
+    if (type != NULL)
+	return type;
+
+    if (xpybModule_setup == NULL) {
+	PyErr_SetString(xpybExcept_base, "No core protocol module has been loaded.");
+	return NULL;
+    }
+
+    modname = PyObject_GetAttrString((PyObject *)xpybModule_setup, "__module__");
+    if (modname == NULL)
+	return NULL;
+    mod = PyImport_Import(modname);
+    Py_DECREF(modname);
+    if (mod == NULL)
+	return NULL;
+
+    type = PyObject_GetAttrString(mod, name);
+    Py_DECREF(mod);
+    if (type == NULL)
+	return NULL;
+
+    if (PyDict_SetItemString(self->types, name, type) < 0) {
+	Py_DECREF(type);
+	return NULL;
+    }
+    Py_DECREF(type);
+    return type;
+}
+
+static PyObject *
+xpybSetupidx_decode(xpybSetupidx *self, const char *name, PyObject *offset, Py_ssize_t size)
+{
+    PyObject *type = xpybSetupidx_type_of(self, name);
+
+    if (type == NULL)
+	return NULL;
+    if (size < 0)
+	return PyObject_CallFunctionObjArgs(type, self, offset, NULL);
+    return PyObject_CallFunction(type, "OOn", self, offset, size);
+}
+
+PyObject *
+xpybSetupidx_create(xpybConn *conn)
+{
+    xpybSetupidx *self;
+
+    if (xpybConn_invalid(conn))
+	return NULL;
+
+    self = PyObject_New(xpybSetupidx, &xpybSetupidx_type);
+    if (self == NULL)
+	return NULL;
+
+    self->conn = conn;
+    self->setup = xcb_get_setup(conn->conn);
+    self->size = 8 + self->setup->length * 4;
+    self->visuals = PyDict_New();
+    self->depths = PyDict_New();
+    self->formats = PyDict_New();
+    self->screens = PyList_New(0);
+    self->types = PyDict_New();
+
+    if (self->visuals == NULL || self->depths == NULL || self->formats == NULL ||
+	self->screens == NULL || self->types == NULL || xpybSetupidx_build(self) < 0) {
+	Py_DECREF(self);
+	return NULL;
+    }
+
+    return (PyObject *)self;
+}
+
+
+/*
+ * Infrastructure
+ */
+
+static void
+xpybSetupidx_dealloc(xpybSetupidx *self)
+{
+    Py_CLEAR(self->visuals);
+    Py_CLEAR(self->depths);
+    Py_CLEAR(self->formats);
+    Py_CLEAR(self->screens);
+    Py_CLEAR(self->types);
+    self->ob_type->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+xpybSetupidx_readbuf(xpybSetupidx *self, Py_ssize_t s, void **p)
+{
+    if (s != 0) {
+	PyErr_SetString(PyExc_SystemError, "Accessing non-existent buffer segment.");
+	return -1;
+    }
+    if (self->conn == NULL || self->conn->conn == NULL) {
+	PyErr_SetString(xpybExcept_base, "Invalid connection.");
+	return -1;
+    }
+
+    *p = (void *)self->setup;
+    return self->size;
+}
+
+static Py_ssize_t
+xpybSetupidx_segcount(xpybSetupidx *self, Py_ssize_t *s)
+{
+    if (s)
+	*s = self->size;
+    return 1;
+}
+
+static Py_ssize_t
+xpybSetupidx_charbuf(xpybSetupidx *self, Py_ssize_t s, char **p)
+{
+    return xpybSetupidx_readbuf(self, s, (void **)p);
+}
+
+static Py_ssize_t
+xpybSetupidx_length(xpybSetupidx *self)
+{
+    return PyList_GET_SIZE(self->screens);
+}
+
+static PyObject *
+xpybSetupidx_item(xpybSetupidx *self, Py_ssize_t i)
+{
+    if (i < 0 || i >= PyList_GET_SIZE(self->screens)) {
+	PyErr_SetString(PyExc_IndexError, "Screen number out of range.");
+	return NULL;
+    }
+
+    return xpybSetupidx_decode(self, "SCREEN", PyList_GET_ITEM(self->screens, i), -1);
+}
+
+
+/*
+ * Members
+ */
+
+
+/*
+ * Methods
+ */
+
+static PyObject *
+xpybSetupidx_visual(xpybSetupidx *self, PyObject *args)
+{
+    PyObject *key, *entry;
+
+    if (!PyArg_ParseTuple(args, "O", &key))
+	return NULL;
+
+    entry = PyDict_GetItem(self->visuals, key);
+    if (entry == NULL)
+	Py_RETURN_NONE;
+
+    return xpybSetupidx_decode(self, "VISUALTYPE", PyTuple_GET_ITEM(entry, 2),
+			       XPYB_VISUALTYPE_SIZE);
+}
+
+static PyObject *
+xpybSetupidx_visual_info(xpybSetupidx *self, PyObject *args)
+{
+    PyObject *key, *entry;
+
+    if (!PyArg_ParseTuple(args, "O", &key))
+	return NULL;
+
+    entry = PyDict_GetItem(self->visuals, key);
+    if (entry == NULL)
+	Py_RETURN_NONE;
+
+    return PyTuple_GetSlice(entry, 0, 2);
+}
+
+static PyObject *
+xpybSetupidx_visuals(xpybSetupidx *self, PyObject *args)
+{
+    PyObject *key, *entry, *type;
+    int screen, depth;
+
+    if (!PyArg_ParseTuple(args, "ii", &screen, &depth))
+	return NULL;
+
+    key = Py_BuildValue("(ii)", screen, depth);
+    if (key == NULL)
+	return NULL;
+    entry = PyDict_GetItem(self->depths, key);
+    Py_DECREF(key);
+
+    if (entry == NULL)
+	return PyList_New(0);
+
+    type = xpybSetupidx_type_of(self, "VISUALTYPE");
+    if (type == NULL)
+	return NULL;
+
+    return PyObject_CallFunction((PyObject *)&xpybList_type, "OOOOn", self,
+				 PyTuple_GET_ITEM(entry, 0), PyTuple_GET_ITEM(entry, 1),
+				 type, (Py_ssize_t)XPYB_VISUALTYPE_SIZE);
+}
+
+static PyObject *
+xpybSetupidx_pixmap_format(xpybSetupidx *self, PyObject *args)
+{
+    PyObject *key, *entry;
+
+    if (!PyArg_ParseTuple(args, "O", &key))
+	return NULL;
+
+    entry = PyDict_GetItem(self->formats, key);
+    if (entry == NULL)
+	Py_RETURN_NONE;
+
+    return xpybSetupidx_decode(self, "FORMAT", entry, XPYB_FORMAT_SIZE);
+}
+
+static PyMethodDef xpybSetupidx_methods[] = {
+    { "visual",
+      (PyCFunction)xpybSetupidx_visual,
+      METH_VARARGS,
+      "Returns the VISUALTYPE with the given visual id, or None." },
+
+    { "visual_info",
+      (PyCFunction)xpybSetupidx_visual_info,
+      METH_VARARGS,
+      "Returns a (screen, depth) tuple for the given visual id, or None." },
+
+    { "visuals",
+      (PyCFunction)xpybSetupidx_visuals,
+      METH_VARARGS,
+      "Returns the visuals of the given screen and depth." },
+
+    { "pixmap_format",
+      (PyCFunction)xpybSetupidx_pixmap_format,
+      METH_VARARGS,
+      "Returns the pixmap FORMAT for the given depth, or None." },
+
+    { NULL } /* terminator */
+};
+
+
+/*
+ * Definition
+ */
+
+static PyBufferProcs xpybSetupidx_bufops = {
+    .bf_getreadbuffer = (readbufferproc)xpybSetupidx_readbuf,
+    .bf_getsegcount = (segcountproc)xpybSetupidx_segcount,
+    .bf_getcharbuffer = (charbufferproc)xpybSetupidx_charbuf
+};
+
+static PySequenceMethods xpybSetupidx_seqops = {
+    .sq_length = (lenfunc)xpybSetupidx_length,
+    .sq_item = (ssizeargfunc)xpybSetupidx_item
+};
+
+PyTypeObject xpybSetupidx_type = {
+    PyObject_HEAD_INIT(NULL)
+    .tp_name = "xcb.SetupIndex",
+    .tp_basicsize = sizeof(xpybSetupidx),
+    .tp_dealloc = (destructor)xpybSetupidx_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG,
+    .tp_doc = "XCB index over the connection setup data",
+    .tp_methods = xpybSetupidx_methods,
+    .tp_as_buffer = &xpybSetupidx_bufops,
+    .tp_as_sequence = &xpybSetupidx_seqops
+};
+
+
+/*
+ * Module init
+ */
+int xpybSetupidx_modinit(PyObject *m)
+{
+    if (PyType_Ready(&xpybSetupidx_type) < 0)
+        return -1;
+    Py_INCREF(&xpybSetupidx_type);
+    if (PyModule_AddObject(m, "SetupIndex", (PyObject *)&xpybSetupidx_type) < 0)
+	return -1;
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef XPYB_SETUPIDX_H
+#define XPYB_SETUPIDX_H
+
+#include "conn.h"
+
+typedef struct {
+    PyObject_HEAD
+    xpybConn *conn;	/* owned by conn, which clears this on dealloc */
+    const xcb_setup_t *setup;
+    Py_ssize_t size;
+    PyObject *visuals;
+    PyObject *depths;
+    PyObject *formats;
+    PyObject *screens;
+    PyObject *types;
+} xpybSetupidx;
+
+extern PyTypeObject xpybSetupidx_type;
+
+PyObject *xpybSetupidx_create(xpybConn *conn);
+
+int xpybSetupidx_modinit(PyObject *m);
+
+#endif
@@ -25,7 +25,7 @@ PyTypeObject xpybStruct_type = {
     PyObject_HEAD_INIT(NULL)
     .tp_name = "xcb.Struct",
     .tp_basicsize = sizeof(xpybStruct),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic struct object",
     .tp_base = &xpybProtobj_type,
 };
@@ -25,7 +25,7 @@ PyTypeObject xpybUnion_type = {
     PyObject_HEAD_INIT(NULL)
     .tp_name = "xcb.Union",
     .tp_basicsize = sizeof(xpybUnion),
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_VERSION_TAG | Py_TPFLAGS_BASETYPE,
     .tp_doc = "XCB generic union object",
     .tp_base = &xpybProtobj_type,
 };
@@ -4,6 +4,8 @@
 #include <Python.h>
 #include <xcb/xcb.h>
 
+struct xpybConnPrivate;
+
 typedef struct {
     PyObject_HEAD
     xcb_connection_t *conn;
@@ -17,13 +19,62 @@ typedef struct {
     int events_len;
     PyObject **errors;
     int errors_len;
+    /* State private to the binding, declared in its conn.h */
+    struct xpybConnPrivate *priv;
 } xpybConn;
 
+/* Version of the C API table; new members are only ever appended */
+#define XPYB_CAPI_VERSION 1
+
+/*
+ * C API for other extension modules.  xpyb_IMPORT only guarantees the
+ * first member; xpyb_IMPORT_CAPSULE returns the full table, whose version
+ * tells which of the later members are present.  All functions need the
+ * GIL and return NULL or -1 with a Python exception set on failure.
+ */
 typedef struct {
     PyTypeObject *xpybConn_type;
+
+    /* Present from version 1 */
+    int version;
+    PyTypeObject *xpybCookie_type;
+    PyTypeObject *xpybExt_type;
+    PyTypeObject *xpybExtkey_type;
+
+    /* Sends an encoded request through ext (an xcb.Extension such as
+       conn.core) and returns a new instance of cookie_type for it.
+       reply_type is required unless is_void is set.  data is only read
+       during the call.  The cookie is created without calling
+       cookie_type's __init__. */
+    PyObject *(*send_request)(PyObject *ext, const void *data, Py_ssize_t size,
+			      int opcode, int is_void, int is_checked,
+			      PyTypeObject *cookie_type, PyTypeObject *reply_type);
+    /* Waits for the reply of a cookie, for up to timeout seconds unless
+       timeout is negative.  Errors are raised as Python exceptions, or
+       queued when the connection defers them.  The caller frees the
+       reply. */
+    xcb_generic_reply_t *(*get_reply)(PyObject *cookie, double timeout);
+    /* Take ownership of the data and wrap it in the generated reply type
+       of the cookie or the event type registered for its code.  For an
+       error, returns the exception instance the binding would raise. */
+    PyObject *(*wrap_reply)(PyObject *cookie, xcb_generic_reply_t *reply);
+    PyObject *(*wrap_event)(PyObject *conn, xcb_generic_event_t *event);
+    PyObject *(*wrap_error)(PyObject *conn, xcb_generic_error_t *error);
+    /* Fills in the major opcode, first event and first error code of an
+       extension given its xcb.ExtensionKey */
+    int (*extension_info)(PyObject *conn, PyObject *key, int *major_opcode,
+			  int *first_event, int *first_error);
+    /* Fills ids with n fresh XIDs and returns 0.  If fewer than n can be
+       found, returns -1 with an exception set.  ids may then be partly
+       filled, but those ids stay with the connection for its next
+       allocation and must not be used. */
+    int (*generate_ids)(PyObject *conn, uint32_t *ids, int n);
 } xpyb_CAPI_t;
 
 #define xpyb_IMPORT \
     xpyb_CAPI = (xpyb_CAPI_t *) PyCObject_Import("xcb", "CAPI")
 
+#define xpyb_IMPORT_CAPSULE \
+    xpyb_CAPI = (xpyb_CAPI_t *) PyCapsule_Import("xcb.C_API", 0)
+
 #endif
@@ -0,0 +1,52 @@
+import unittest
+import xcb
+
+
+class FreelistTest(unittest.TestCase):
+
+    def setUp(self):
+        self.saved = dict((name, s['max']) for name, s in xcb.freelist_stats().items())
+
+    def tearDown(self):
+        for name, max in self.saved.items():
+            xcb.set_freelist_max(name, max)
+
+    def test_stats(self):
+        stats = xcb.freelist_stats()
+        self.assertEqual(sorted(stats.keys()), ['cookie', 'protobj', 'rawbuf'])
+        for s in stats.values():
+            self.assertEqual(sorted(s.keys()), ['hits', 'length', 'max', 'misses'])
+            self.failUnless(0 <= s['length'] <= s['max'])
+
+    def test_reuse(self):
+        xcb.set_freelist_max('protobj', 16)
+        objs = [xcb.Protobj('abcd') for i in range(8)]
+        del objs
+        before = xcb.freelist_stats()['protobj']
+        self.failUnless(before['length'] >= 8)
+        obj = xcb.Protobj('abcd')
+        after = xcb.freelist_stats()['protobj']
+        self.assertEqual(after['hits'], before['hits'] + 1)
+        self.assertEqual(after['length'], before['length'] - 1)
+        self.assertEqual(str(buffer(obj)), 'abcd')
+
+    def test_set_max_trims(self):
+        objs = [xcb.Protobj('abcd') for i in range(8)]
+        del objs
+        xcb.set_freelist_max('protobj', 2)
+        stats = xcb.freelist_stats()['protobj']
+        self.assertEqual(stats['max'], 2)
+        self.failUnless(stats['length'] <= 2)
+
+        xcb.set_freelist_max('protobj', 0)
+        objs = [xcb.Protobj('abcd') for i in range(4)]
+        del objs
+        self.assertEqual(xcb.freelist_stats()['protobj']['length'], 0)
+
+    def test_set_max_errors(self):
+        self.assertRaises(ValueError, xcb.set_freelist_max, 'cookie', -1)
+        self.assertRaises(xcb.Exception, xcb.set_freelist_max, 'nope', 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
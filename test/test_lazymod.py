@@ -0,0 +1,35 @@
+import unittest
+import xcb
+import xcb.xproto
+
+
+class LazyModuleTest(unittest.TestCase):
+
+    def test_type(self):
+        self.failUnless(isinstance(xcb.xproto, xcb.LazyModule))
+        self.assertEqual(xcb.xproto.__name__, 'xcb.xproto')
+
+    def test_all_lists_lazy_names(self):
+        names = xcb.xproto.__all__
+        self.failUnless('ExposeEvent' in names)
+        self.failUnless('xprotoExtension' in names)
+        self.assertEqual(len(names), len(set(names)))
+
+    def test_class_built_once(self):
+        cls = xcb.xproto.ExposeEvent
+        self.failUnless(xcb.xproto.ExposeEvent is cls)
+        self.assertEqual(cls.__module__, 'xcb.xproto')
+
+    def test_star_import(self):
+        ns = {}
+        exec 'from xcb.xproto import *' in ns
+        for name in xcb.xproto.__all__:
+            self.failUnless(name in ns, name)
+        self.failUnless(ns['ExposeEvent'] is xcb.xproto.ExposeEvent)
+
+    def test_missing_name(self):
+        self.assertRaises(AttributeError, getattr, xcb.xproto, 'NoSuchName')
+
+
+if __name__ == '__main__':
+    unittest.main()
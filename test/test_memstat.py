@@ -0,0 +1,48 @@
+import gc
+import unittest
+import xcb
+
+
+class MemoryStatsTest(unittest.TestCase):
+
+    def tearDown(self):
+        xcb.memory_stats(enable=False)
+
+    def test_off_by_default(self):
+        self.failUnless(xcb.memory_stats() is None)
+        self.failUnless(xcb.memory_stats(enable=False) is None)
+
+    def test_enable(self):
+        stats = xcb.memory_stats(enable=True)
+        self.assertEqual(sorted(stats.keys()),
+                         ['buffers', 'cookies', 'errors', 'events', 'lists',
+                          'pinned', 'replies', 'requests', 'structs', 'unions'])
+        self.failUnless(xcb.memory_stats() is not None)
+
+    def test_counts_live_objects(self):
+        xcb.memory_stats(enable=True)
+        requests = [xcb.Request('\0' * 8, 1, False, False) for i in range(5)]
+        stats = xcb.memory_stats()['requests']
+        self.assertEqual(stats['count'], 5)
+        self.assertEqual(stats['types'][xcb.Request]['count'], 5)
+        del requests
+        gc.collect()
+        self.assertEqual(xcb.memory_stats()['requests']['count'], 0)
+
+    def test_only_counts_objects_made_while_on(self):
+        early = xcb.Request('\0' * 8, 1, False, False)
+        xcb.memory_stats(enable=True)
+        self.assertEqual(xcb.memory_stats()['requests']['count'], 0)
+        del early
+        self.assertEqual(xcb.memory_stats()['requests']['count'], 0)
+
+    def test_disable_drops_counts(self):
+        xcb.memory_stats(enable=True)
+        request = xcb.Request('\0' * 8, 1, False, False)
+        self.failUnless(xcb.memory_stats(enable=False) is None)
+        stats = xcb.memory_stats(enable=True)
+        self.assertEqual(stats['requests']['count'], 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
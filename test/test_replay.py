@@ -0,0 +1,53 @@
+import struct
+import unittest
+import xcb
+import xcb.xproto
+
+
+def key_press(window, time=1):
+    return struct.pack('<BBHIIIIhhhhHBx', 2, 10, 0, time, 1, window, 0,
+                       0, 0, 0, 0, 0, 1)
+
+
+def expose(window):
+    return struct.pack('<BxHIHHHHH14x', 12, 0, window, 1, 2, 3, 4, 0)
+
+
+class ReplayTest(unittest.TestCase):
+
+    def test_decode(self):
+        seen = []
+        xcb.replay_events([key_press(5), expose(6)], seen.append)
+        self.assertEqual([type(e) for e in seen],
+                         [xcb.xproto.KeyPressEvent, xcb.xproto.ExposeEvent])
+        self.assertEqual(seen[0].event, 5)
+        self.assertEqual(seen[1].window, 6)
+
+    def test_report(self):
+        report = xcb.replay_events([key_press(5), expose(6), key_press(7)], repeat=10)
+        self.assertEqual(report['events'], 30)
+        self.assertEqual(report['types'][2]['count'], 20)
+        self.assertEqual(report['types'][12]['count'], 10)
+        self.failUnless('allocations' in report)
+
+    def test_repeat_zero(self):
+        self.assertEqual(xcb.replay_events([expose(1)], repeat=0)['events'], 0)
+
+    def test_generic_event(self):
+        record = struct.pack('<BBHIH22x', 35, 0, 0, 2, 5) + 'ABCDEFGH'
+        seen = []
+        xcb.replay_events([record], seen.append)
+        self.assertEqual(str(buffer(seen[0]))[32:], 'ABCDEFGH')
+
+    def test_error_needs_connection(self):
+        record = struct.pack('<BBHIHBx20x', 0, 3, 0, 0, 0, 2)
+        self.assertRaises(ValueError, xcb.replay_events, [record])
+
+    def test_handler_exception(self):
+        def handler(event):
+            raise KeyError(event)
+        self.assertRaises(KeyError, xcb.replay_events, [expose(1)], handler)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,33 @@
+import unittest
+import xcb
+
+# The generated modules reach it through their implicit import of xcb.xcb
+from xcb.xcb import _resize_obj
+
+
+class ResizeTest(unittest.TestCase):
+
+    def test_shrink(self):
+        obj = xcb.Protobj('abcdefgh')
+        _resize_obj(obj, 4)
+        self.assertEqual(len(obj), 4)
+        self.assertEqual(str(buffer(obj)), 'abcd')
+
+    def test_never_grows(self):
+        obj = xcb.Protobj('abcdefgh', 0, 4)
+        _resize_obj(obj, 6)
+        self.assertEqual(str(buffer(obj)), 'abcd')
+
+    def test_nested_window(self):
+        outer = xcb.Protobj('abcdefgh')
+        inner = xcb.Protobj(outer, 2)
+        _resize_obj(inner, 3)
+        self.assertEqual(str(buffer(inner)), 'cde')
+
+    def test_errors(self):
+        self.assertRaises(ValueError, _resize_obj, xcb.Protobj('ab'), -1)
+        self.assertRaises(TypeError, _resize_obj, 'ab', 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
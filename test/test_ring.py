@@ -0,0 +1,65 @@
+import os
+import struct
+import unittest
+import xcb
+import xcb.xproto
+
+
+def expose(window):
+    return struct.pack('<BxHIHHHHH14x', 12, 0, window, 1, 2, 3, 4, 0)
+
+
+def events(records):
+    seen = []
+    xcb.replay_events(records, seen.append)
+    return seen
+
+
+class EventRingTest(unittest.TestCase):
+
+    def setUp(self):
+        self.name = '/xpyb-test-%d' % os.getpid()
+        self.owner = xcb.EventRing(self.name, create=True, slots=8,
+                                   slot_size=64, replace=True)
+        self.reader = xcb.EventRing(self.name)
+
+    def tearDown(self):
+        self.owner.unlink()
+
+    def test_publish_read(self):
+        for event in events([expose(1), expose(2)]):
+            self.owner.publish(event)
+        got = [self.reader.read(timeout=0) for i in range(2)]
+        self.assertEqual([type(e) for e in got], [xcb.xproto.ExposeEvent] * 2)
+        self.assertEqual([e.window for e in got], [1, 2])
+        self.failUnless(self.reader.read(timeout=0) is None)
+
+    def test_subscribe(self):
+        self.reader.subscribe(windows=[2])
+        for event in events([expose(1), expose(2), expose(3)]):
+            self.owner.publish(event)
+        self.assertEqual(self.reader.read(timeout=0).window, 2)
+        self.failUnless(self.reader.read(timeout=0) is None)
+
+    def test_overrun(self):
+        for event in events([expose(i) for i in range(20)]):
+            self.owner.publish(event)
+        got = []
+        while True:
+            event = self.reader.read(timeout=0)
+            if event is None:
+                break
+            got.append(event.window)
+        self.assertEqual(got, range(12, 20))
+        self.assertEqual(self.reader.lost, 12)
+
+    def test_exists(self):
+        self.assertRaises(OSError, xcb.EventRing, self.name, create=True)
+
+    def test_reader_cannot_publish(self):
+        event = events([expose(1)])[0]
+        self.assertRaises(xcb.Exception, self.reader.publish, event)
+
+
+if __name__ == '__main__':
+    unittest.main()